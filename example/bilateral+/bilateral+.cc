@@ -150,9 +150,9 @@ void BilateralPlus::prepare() {
 }
 
 void BilateralPlus::clear() {
-  this->lookup = {};
-  this->schedules = {};
-  this->routes = {};
+  this->lookup.clear();
+  this->schedules.clear();
+  this->routes.clear();
   this->modified = {};
   this->to_assign = {};
   this->to_unassign = {};
@@ -37,9 +37,9 @@ class BilateralPlus : public RSAlgorithm {
   Grid grid_;
   int nswapped_;
 
-  dict<CustId, vec_t<rank_cand>> lookup;
-  dict<CustId, dict<VehlId, vec_t<Stop>>> schedules;
-  dict<CustId, dict<VehlId, vec_t<Wayp>>> routes;
+  TripTable<vec_t<rank_cand>> lookup;
+  TripTable<dict<VehlId, vec_t<Stop>>> schedules;
+  TripTable<dict<VehlId, vec_t<Wayp>>> routes;
   dict<MutableVehicleSptr, bool> modified;
   dict<MutableVehicleSptr, vec_t<CustId>> to_assign;
   dict<MutableVehicleSptr, vec_t<CustId>> to_unassign;
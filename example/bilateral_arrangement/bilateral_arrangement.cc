@@ -143,9 +143,9 @@ void BilateralArrangement::prepare() {
 }
 
 void BilateralArrangement::clear() {
-  this->lookup = {};
-  this->schedules = {};
-  this->routes = {};
+  this->lookup.clear();
+  this->schedules.clear();
+  this->routes.clear();
   this->modified = {};
   this->to_assign = {};
   this->to_unassign = {};
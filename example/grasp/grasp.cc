@@ -590,7 +590,13 @@ void GRASP::commit(const Solution& solution) {
     const vec_t<CustId>& cadd = kv.second.first;
     const vec_t<CustId>& cdel = kv.second.second;
     cand->reset_lvn();
-    this->assign_or_delay(cadd, cdel, cand->route().data(), cand->schedule().data(), *cand);
+    this->assign_later(cadd, cdel, cand->route().data(), cand->schedule().data(), *cand,
+      [this, cadd](bool ok, MutableVehicle &) {
+        for (const CustId& cid : cadd) {
+          if (ok) this->end_delay(cid);
+          else    this->beg_delay(cid);
+        }
+      });
     for (const CustId& cid : cadd) print << "Matched " << cid << " to vehl " << cand->id() << std::endl;
     for (const CustId& cid : cdel) print << "Removed " << cid << " from vehl " << cand->id() << std::endl;
   }
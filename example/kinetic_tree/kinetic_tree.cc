@@ -41,11 +41,6 @@ KineticTrees::KineticTrees(const std::string& name)
   this->batch_time() = BATCH;
 }
 
-KineticTrees::~KineticTrees() {
-  for (auto kv : kt_)
-    delete kv.second;
-}
-
 void KineticTrees::handle_customer(const Customer& cust) {
   DistInt range = pickup_range(cust);
   this->reset_workspace();
@@ -90,7 +85,7 @@ void KineticTrees::handle_customer(const Customer& cust) {
       best_vehl->route().dist_at(best_vehl->idx_last_visited_node() + 1);
     if (this->assign({cust.id()}, {}, best_rte, best_sch, *best_vehl)) {
       this->kt_.at(best_vehl->id())->push();
-      this->sync_kt(kt_.at(best_vehl->id()), best_vehl->schedule().data());
+      this->sync_kt(kt_.at(best_vehl->id()).get(), best_vehl->schedule().data());
       this->end_delay(cust.id());
     } else
       this->beg_delay(cust.id());
@@ -107,8 +102,8 @@ void KineticTrees::handle_vehicle(const Vehicle& vehl) {
     NodeId dest = vehl.dest();
     if (vehl.late() == -1)
       dest = -1;  // special node for taxis
-    this->kt_[vehl.id()] =
-      new TreeTaxiPath(vehl.schedule().data().at(0).loc(), dest, vehl.id());
+    this->kt_[vehl.id()].reset(
+      new TreeTaxiPath(vehl.schedule().data().at(0).loc(), dest, vehl.id()));
   }
 
   // Create last-modified entry if none exists
@@ -118,7 +113,7 @@ void KineticTrees::handle_vehicle(const Vehicle& vehl) {
   // Synchronize kinetic tree stops with local schedule for vehl
     if (this->sched_.count(vehl.id()) != 0) {
       if (this->sched_.at(vehl.id()).at(0).loc() != vehl.dest()) {
-        this->sync_kt(this->kt_.at(vehl.id()), vehl.schedule().data());
+        this->sync_kt(this->kt_.at(vehl.id()).get(), vehl.schedule().data());
       }
     }
   // }
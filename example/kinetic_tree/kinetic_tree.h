@@ -33,7 +33,6 @@ using namespace cargo;
 class KineticTrees : public RSAlgorithm {
  public:
   KineticTrees(const std::string &);
-  ~KineticTrees();
 
   /* My overrides */
   virtual void handle_customer(const Customer &);
@@ -53,9 +52,9 @@ class KineticTrees : public RSAlgorithm {
   tick_t timeout_0;
 
   /* Local containers for vehicle state */
-  std::unordered_map<VehlId, TreeTaxiPath*>     kt_;
-  std::unordered_map<VehlId, std::vector<Stop>> sched_;
-  std::unordered_map<VehlId, SimlTime>          last_modified_;
+  TripTable<std::unique_ptr<TreeTaxiPath>>     kt_;
+  TripTable<std::vector<Stop>>                 sched_;
+  TripTable<SimlTime>                          last_modified_;
 
   void sync_kt(TreeTaxiPath *, const std::vector<Stop> &);
 
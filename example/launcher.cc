@@ -20,16 +20,7 @@
 #include <iostream>
 
 #include "libcargo.h"
-#include "bilateral+/bilateral+.h"
-#include "bilateral_arrangement/bilateral_arrangement.h"
-#include "grabby/grabby.h"
-#include "grasp/grasp.h"
-#include "greedy/greedy.h"
-#include "kinetic_tree/kinetic_tree.h"
-#include "nearest_neighbor/nearest_neighbor.h"
-#include "nearest_road/nearest_road.h"
-#include "simulated_annealing/simulated_annealing.h"
-#include "trip_vehicle_grouping/trip_vehicle_grouping.h"
+#include "selection.h"
 
 void print_header() {
   std::cout
@@ -92,30 +83,7 @@ int main(int argc, char** argv) {
   op.strict_mode = strictmode;
   Cargo cargo(op);
 
-  if (selection == "1") {
-    BilateralPlus alg("bp_"+cargo.name()); cargo.start(alg);
-  } else if (selection == "2") {
-    BilateralArrangement alg("ba_"+cargo.name()); cargo.start(alg);
-  } else if (selection == "3") {
-    Grabby alg("gb_"+cargo.name()); cargo.start(alg);
-  } else if (selection == "4") {
-    Greedy alg("gr_"+cargo.name()); cargo.start(alg);
-  } else if (selection == "5") {
-    KineticTrees alg("kt_"+cargo.name()); cargo.start(alg);
-  } else if (selection == "6") {
-    NearestNeighbor alg("nn_"+cargo.name()); cargo.start(alg);
-  } else if (selection == "7") {
-    GRASP alg("gp4_"+cargo.name(), 4); cargo.start(alg);
-  } else if (selection == "8") {
-    GRASP alg("gp16_"+cargo.name(), 16); cargo.start(alg);
-  } else if (selection == "9") {
-    SimulatedAnnealing alg("sa50_"+cargo.name(), 50); cargo.start(alg);
-  } else if (selection == "10") {
-    SimulatedAnnealing alg("sa100_"+cargo.name(), 100); cargo.start(alg);
-  } else if (selection == "11") {
-    TripVehicleGrouping alg("tg_"+cargo.name()); cargo.start(alg);
-  } else if (selection == "12") {
-    NearestRoad alg("nr_"+cargo.name()); cargo.start(alg);
-  }
+  if (run_selection(selection, cargo).empty())
+    std::cout << "Unknown selection " << selection << std::endl;
 }
 
@@ -0,0 +1,80 @@
+// Copyright (c) 2019 the Cargo authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef CARGO_EXAMPLE_SELECTION_H_
+#define CARGO_EXAMPLE_SELECTION_H_
+#include <string>
+
+#include "libcargo.h"
+#include "bilateral+/bilateral+.h"
+#include "bilateral_arrangement/bilateral_arrangement.h"
+#include "grabby/grabby.h"
+#include "grasp/grasp.h"
+#include "greedy/greedy.h"
+#include "kinetic_tree/kinetic_tree.h"
+#include "nearest_neighbor/nearest_neighbor.h"
+#include "nearest_road/nearest_road.h"
+#include "simulated_annealing/simulated_annealing.h"
+#include "trip_vehicle_grouping/trip_vehicle_grouping.h"
+
+/* Run algorithm selection (1-12, see launcher) on a Cargo. Returns the name
+ * of the algorithm (its output files are named after it), or "" if the
+ * selection is unknown. */
+inline std::string run_selection(const std::string& selection, Cargo& cargo) {
+  if (selection == "1") {
+    BilateralPlus alg("bp_"+cargo.name()); cargo.start(alg);
+    return alg.name();
+  } else if (selection == "2") {
+    BilateralArrangement alg("ba_"+cargo.name()); cargo.start(alg);
+    return alg.name();
+  } else if (selection == "3") {
+    Grabby alg("gb_"+cargo.name()); cargo.start(alg);
+    return alg.name();
+  } else if (selection == "4") {
+    Greedy alg("gr_"+cargo.name()); cargo.start(alg);
+    return alg.name();
+  } else if (selection == "5") {
+    KineticTrees alg("kt_"+cargo.name()); cargo.start(alg);
+    return alg.name();
+  } else if (selection == "6") {
+    NearestNeighbor alg("nn_"+cargo.name()); cargo.start(alg);
+    return alg.name();
+  } else if (selection == "7") {
+    GRASP alg("gp4_"+cargo.name(), 4); cargo.start(alg);
+    return alg.name();
+  } else if (selection == "8") {
+    GRASP alg("gp16_"+cargo.name(), 16); cargo.start(alg);
+    return alg.name();
+  } else if (selection == "9") {
+    SimulatedAnnealing alg("sa50_"+cargo.name(), 50); cargo.start(alg);
+    return alg.name();
+  } else if (selection == "10") {
+    SimulatedAnnealing alg("sa100_"+cargo.name(), 100); cargo.start(alg);
+    return alg.name();
+  } else if (selection == "11") {
+    TripVehicleGrouping alg("tg_"+cargo.name()); cargo.start(alg);
+    return alg.name();
+  } else if (selection == "12") {
+    NearestRoad alg("nr_"+cargo.name()); cargo.start(alg);
+    return alg.name();
+  }
+  return "";
+}
+
+#endif  // CARGO_EXAMPLE_SELECTION_H_
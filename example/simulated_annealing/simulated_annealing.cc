@@ -336,13 +336,7 @@ void SimulatedAnnealing::commit() {
     vec_t<CustId> cadd = {};
     vec_t<CustId> cdel = {};
     for (const Customer& cust : kv.second.second) cadd.push_back(cust.id());
-    if (this->assign(cadd, cdel, cand.route().data(), cand.schedule().data(), cand)) {
-      // for (const CustId& cid : cadd)
-      //   print << "Matched " << cid << " with " << cand.id() << std::endl;
-    } // else {
-      // for (const CustId& cid : cadd)
-      //   print(MessageType::Warning) << "Rejected due to sync " << cid << " with " << cand.id() << std::endl;
-    // }
+    this->assign_later(cadd, cdel, cand.route().data(), cand.schedule().data(), cand);
   }
 }
 
@@ -379,8 +373,8 @@ void SimulatedAnnealing::reset_workspace() {
   //this->tried = {};
   this->sch = this->sch_after_rem = this->sch_after_add = {};
   this->rte = this->rte_after_rem = this->rte_after_add = {};
-  this->candidates_list = {};
-  this->vehicle_lookup = {};
+  this->candidates_list.clear();
+  this->vehicle_lookup.clear();
   this->timeout_0 = hiclock::now();
   this->best_sol = {};
   this->commit_cadd = {};
@@ -59,8 +59,8 @@ class SimulatedAnnealing : public RSAlgorithm {
   /* Workspace variables */
   SASol sol;
   //dict<CustId, std::set<VehlId>> tried;
-  dict<CustId, vec_t<MutableVehicleSptr>> candidates_list;
-  dict<VehlId, MutableVehicleSptr> vehicle_lookup;
+  TripTable<vec_t<MutableVehicleSptr>> candidates_list;
+  TripTable<MutableVehicleSptr> vehicle_lookup;
   tick_t timeout_0;
   std::vector<Stop> sch, sch_after_rem, sch_after_add;
   std::vector<Wayp> rte, rte_after_rem, rte_after_add;
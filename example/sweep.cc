@@ -0,0 +1,226 @@
+// Copyright (c) 2019 the Cargo authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "libcargo.h"
+#include "selection.h"
+
+/* Parameter sweep: run every selected algorithm on every instance, several
+ * runs at a time, and collect the .sol files into sweep.csv. The road
+ * network is loaded once before the runs are forked, so each run shares the
+ * parent's copy (copy-on-write) instead of reading the files again. Run k
+ * works in its own directory sweep_<k>/, where it writes its console output
+ * (sweep.log) and its .dat/.sol files, and sends its algorithm name and .sol
+ * back through a pipe. */
+
+struct Scenario {
+  std::string selection;
+  std::string instance;
+  std::string name;                         // algorithm name (sent by run)
+  std::string sol;                          // .sol contents (sent by run)
+  pid_t pid;
+  int fd;                                   // read end of the name pipe
+  int status;
+};
+
+void print_usage() {
+  std::cout
+    << "Usage: ./sweep selections(e.g. 4,7,8) jobs static(0-1) time_multiplier *.rnet *.instance [*.instance ...]\n"
+    << std::endl;
+}
+
+std::string run_dir(size_t k) { return "sweep_"+std::to_string(k); }
+
+/* Absolute path of an existing file (paths stay valid after chdir) */
+std::string absolute(const std::string& path) {
+  char buf[PATH_MAX];
+  if (!realpath(path.c_str(), buf))
+    throw std::runtime_error(path+": "+std::strerror(errno));
+  return buf;
+}
+
+/* Child: run one scenario in run_dir(k) and send "name\n<.sol contents>" to
+ * the parent */
+int run(const Scenario& sc, const Options& base, int fd, size_t k) {
+  const std::string dir = run_dir(k);
+  if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) return 1;
+  if (chdir(dir.c_str()) != 0) return 1;
+  if (!std::freopen("sweep.log", "w", stdout)) return 1;
+  dup2(fileno(stdout), fileno(stderr));
+  Options op = base;
+  op.path_to_problem = sc.instance;
+  std::string name;
+  { Cargo cargo(op);
+    name = run_selection(sc.selection, cargo);
+  }  // cargo writes its .sol and closes here
+  if (name.empty()) return 1;
+  std::ifstream f(name+".sol");
+  std::string msg = name+"\n"+std::string(std::istreambuf_iterator<char>(f), {});
+  if (write(fd, msg.data(), msg.size()) != (ssize_t)msg.size()) return 1;
+  return 0;
+}
+
+/* "Label (unit)    value" lines of a .sol file, in order */
+vec_t<std::pair<std::string, std::string>> read_sol(const std::string& sol) {
+  vec_t<std::pair<std::string, std::string>> fields;
+  std::istringstream f(sol);
+  std::string line;
+  for (int i = 0; std::getline(f, line); ++i) {
+    if (i < 2) continue;  // instance and road network names
+    const size_t end = line.find_last_not_of(' ');
+    const size_t sep = line.find_last_of(' ', end);
+    if (end == std::string::npos || sep == std::string::npos) continue;
+    std::string label;
+    std::istringstream words(line.substr(0, sep));
+    for (std::string w; words >> w; ) label += (label.empty() ? "" : " ") + w;
+    fields.push_back({label, line.substr(sep + 1, end - sep)});
+  }
+  return fields;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 7) {
+    print_usage();
+    return 1;
+  }
+  vec_t<std::string> args(argv, argv + argc);
+  vec_t<std::string> selections;
+  { std::istringstream ss(args.at(1));
+    for (std::string sel; std::getline(ss, sel, ','); ) selections.push_back(sel);
+  }
+  const size_t jobs = std::max(1, std::stoi(args.at(2)));
+  Options op;
+  op.static_mode = (args.at(3) != "0");
+  op.time_multiplier = std::stof(args.at(4));
+  op.path_to_roadnet = absolute(args.at(5));
+
+  vec_t<Scenario> scenarios;
+  for (size_t i = 6; i < args.size(); ++i)
+    for (const std::string& sel : selections)
+      scenarios.push_back({sel, absolute(args.at(i)), "", "", -1, -1, -1});
+
+  /* Held until the end, so that the forked runs find it loaded */
+  std::shared_ptr<RoadNetwork> road = Cargo::load_road(op.path_to_roadnet);
+
+  std::map<pid_t, size_t> running;
+  size_t next = 0;
+  while (next < scenarios.size() || !running.empty()) {
+    if (next < scenarios.size() && running.size() < jobs) {
+      Scenario& sc = scenarios.at(next);
+      int fds[2];
+      if (pipe(fds) != 0) {
+        std::cerr << "pipe() failed" << std::endl;
+        return 1;
+      }
+      std::cout.flush();
+      const pid_t pid = fork();
+      if (pid == 0) {
+        close(fds[0]);
+        int rc = 1;
+        try { rc = run(sc, op, fds[1], next); }
+        catch (const std::exception& e) { std::cerr << e.what() << std::endl; }
+        std::fflush(stdout);
+        _exit(rc);
+      }
+      close(fds[1]);
+      if (pid < 0) {
+        close(fds[0]);
+        std::cerr << "fork() failed" << std::endl;
+        return 1;
+      }
+      sc.pid = pid;
+      sc.fd = fds[0];
+      running[pid] = next;
+      std::cout << "[" << next+1 << "/" << scenarios.size() << "] "
+                << "selection " << sc.selection << " on " << sc.instance
+                << " (" << run_dir(next) << "/sweep.log)" << std::endl;
+      next++;
+      continue;
+    }
+    /* Read the pipes of the running runs; a run is reaped once its pipe
+     * closes, so it never blocks writing a .sol larger than the pipe */
+    vec_t<pollfd> fds;
+    for (const auto& kv : running)
+      fds.push_back({scenarios.at(kv.second).fd, POLLIN, 0});
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      std::cerr << "poll() failed" << std::endl;
+      return 1;
+    }
+    size_t i = 0;
+    for (auto it = running.begin(); it != running.end(); ++i) {
+      Scenario& sc = scenarios.at(it->second);
+      char buf[4096];
+      ssize_t n = 0;
+      if (fds.at(i).revents == 0 || (n = read(sc.fd, buf, sizeof(buf))) > 0) {
+        if (n > 0) sc.sol.append(buf, n);
+        ++it;
+        continue;
+      }
+      if (n < 0 && errno == EINTR) { ++it; continue; }
+      close(sc.fd);
+      waitpid(sc.pid, &sc.status, 0);
+      const size_t eol = sc.sol.find('\n');
+      if (eol != std::string::npos) {
+        sc.name = sc.sol.substr(0, eol);
+        sc.sol.erase(0, eol + 1);
+      }
+      if (!WIFEXITED(sc.status) || WEXITSTATUS(sc.status) != 0)
+        std::cerr << "Run " << it->second << " failed (see "
+                  << run_dir(it->second) << "/sweep.log)" << std::endl;
+      it = running.erase(it);
+    }
+  }
+
+  /* One row per run; the columns are the labels of the .sol lines */
+  std::ofstream csv("sweep.csv");
+  bool header = false;
+  for (const Scenario& sc : scenarios) {
+    if (sc.name.empty()) continue;
+    const auto fields = read_sol(sc.sol);
+    if (!header) {
+      csv << "algorithm,selection,instance";
+      for (const auto& kv : fields) csv << ",\"" << kv.first << "\"";
+      csv << "\n";
+      header = true;
+    }
+    csv << sc.name << "," << sc.selection << "," << sc.instance;
+    for (const auto& kv : fields) csv << "," << kv.second;
+    csv << "\n";
+  }
+  std::cout << "Wrote sweep.csv" << std::endl;
+}
@@ -72,12 +72,14 @@ void TripVehicleGrouping::match() {
 
   /* Generate rv-graph */
   { std::vector<Customer> lcl_cust = customers();
+  SimContext& sim = Cargo::ctx();
   //print << "Generating rv-graph..." << std::endl;
   omp_set_num_threads(MAX_THREADS);
   #pragma omp parallel shared(lcl_cust, rvgrph_rr_, rvgrph_rv_, \
          rv_cst, rv_sch, rv_rte, matchable_custs)
   { /* Each thread gets a local gtree and a local grid to perform
-     * sp-computations in parallel */
+     * sp-computations in parallel, on this thread's simulation */
+  Cargo::bind(sim);
   GTree::G_Tree& lcl_gtre = gtre_.at(omp_get_thread_num());
   Grid lcl_grid = grid_;
   #pragma omp for
@@ -197,11 +199,13 @@ void TripVehicleGrouping::match() {
   int nvted = 0;
   print << "Generating rtv-graph" << std::endl;
   { std::vector<Vehicle> lcl_vehl = vehicles();
+  SimContext& sim = Cargo::ctx();
   omp_set_num_threads(MAX_THREADS);
   #pragma omp parallel shared(nvted, lcl_vehl, vt_sch, vt_rte, vehmap, \
           vted_, rvgrph_rr_, rvgrph_rv_)
   { /* Each thread adds edges to a local vtedges; these are combined when
      * all threads have completed */
+  Cargo::bind(sim);
   dict<VehlId, dict<SharedTripId, DistInt>> lcl_vted = {};
   dict<SharedTripId, SharedTrip>            lcl_trip = {};
   GTree::G_Tree                           & lcl_gtre = gtre_.at(omp_get_thread_num());
@@ -588,9 +592,9 @@ void TripVehicleGrouping::match() {
       }
     }
   }
-  for (const auto& kv : is_matched)
-    if (!kv.second)
-      this->beg_delay(kv.first);
+  for (const CustId& cust_id : is_matched.ids())
+    if (!is_matched.at(cust_id))
+      this->beg_delay(cust_id);
 
   glp_delete_prob(mip);
   }  // end mip (if vted_.size() > 0)
@@ -702,11 +706,11 @@ SharedTripId TripVehicleGrouping::add_trip(const SharedTrip& trip) {
 }
 
 void TripVehicleGrouping::reset_workspace() {
-  this->is_matched = {};
-  if (Cargo::static_mode) this->timeout_=300*1000;
+  this->is_matched.clear();
+  if (Cargo::static_mode()) this->timeout_=300*1000;
   this->timeout_ = this->timeout_/2;
   this->stid_ = 0;
   this->trip_ = {};
-  this->cted_ = {};
+  this->cted_.clear();
 }
 
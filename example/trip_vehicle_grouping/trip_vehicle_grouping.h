@@ -48,13 +48,13 @@ class TripVehicleGrouping : public RSAlgorithm {
 
 
   /* Workspace variables */
-  std::unordered_map<CustId, bool> is_matched;
+  TripTable<bool> is_matched;
   tick_t timeout_rv_0;
   tick_t timeout_rtv_0;
 
 
   SharedTripId stid_;
-  dict<CustId, std::vector<SharedTripId>>   cted_;  // cust-trip edges
+  TripTable<std::vector<SharedTripId>>      cted_;  // cust-trip edges
   dict<SharedTripId, SharedTrip>            trip_;  // trip lookup
 
   bool travel(const Vehicle &,                // Can this vehl...
@@ -174,8 +174,9 @@ struct G_Tree { // Here we go!
     //Node *node;
     std::vector<Node> node;
 
-    // In case multiple threads are using the same gtree
-    static std::mutex gtmx;
+    // search() and find_path() only read the tree, so several threads may
+    // query the same gtree at once; the other queries (catch, KNN, cars)
+    // keep scratch state in the nodes and need one gtree per thread.
 
     void save();
     void load();
@@ -191,7 +192,7 @@ struct G_Tree { // Here we go!
     void push_borders_up_catch(int, int = INF);
     void push_borders_down_catch(int, int, int = INF);
     void push_borders_brother_catch(int, int, int = INF);
-    void push_borders_up_path(int, std::vector<int>&);
+    void push_borders_up_path(int, std::vector<int>&, std::vector<int>&);
     int  find_LCA(int, int);
     int  search(int, int);
     int  search_catch(int, int, int = INF);
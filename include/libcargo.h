@@ -26,14 +26,17 @@ namespace cargo {}  // namespace cargo
 
 #include "libcargo/cargo.h"
 #include "libcargo/classes.h"
+#include "libcargo/context.h"
 #include "libcargo/dbsql.h"
 #include "libcargo/distance.h"
+#include "libcargo/events.h"
 #include "libcargo/file.h"
 #include "libcargo/grid.h"
 #include "libcargo/gui.h"
 #include "libcargo/message.h"
 #include "libcargo/options.h"
 #include "libcargo/rsalgorithm.h"
+#include "libcargo/segments.h"
 #include "libcargo/types.h"
 #include "gtree/gtree.h"
 #include "sqlite3/sqlite3.h"
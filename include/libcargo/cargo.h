@@ -21,17 +21,23 @@
 // SOFTWARE.
 #ifndef CARGO_INCLUDE_LIBCARGO_CARGO_H_
 #define CARGO_INCLUDE_LIBCARGO_CARGO_H_
+#include <atomic>
 #include <fstream>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <random>
+#include <stdexcept>
 
 #include "classes.h"
+#include "context.h"
+#include "events.h"
 #include "file.h"
 #include "functions.h"
 #include "message.h"
 #include "options.h"
 #include "rsalgorithm.h"
+#include "segments.h"
 #include "types.h"
 
 #include "../gtree/gtree.h"
@@ -50,69 +56,165 @@ class Cargo {
   const std::string    & name();
   const std::string    & road_network();
   static DistInt         edgew(const NodeId& u, const NodeId& v) {
-                                                     return edges_.at(u).at(v); }
-  static Point           node2pt(const NodeId& i)  { return nodes_.at(i); }
-  static DistInt         basecost(const TripId& i) { return trip_costs_.at(i); }
-  static Customer        basecust(const TripId& i) { return customers_.at(i); }  // INITIAL customer (never gets updated)
-  static BoundingBox     bbox()                    { return bbox_; }
-  static Speed         & vspeed()                  { return speed_; }
-  static SimlTime        now()                     { return t_; }
-  static GTree::G_Tree & gtree()                   { return gtree_; }
-  static sqlite3       * db()                      { return db_; }
-  static bool          & paused()                  { return paused_; }
-  static int           & count_sp()                { return count_sp_; }
+                                  const RoadGraph& g = graph();
+                                  return g.weight(g.index(u), g.index(v)); }
+  static Point           node2pt(const NodeId& i)  { return graph().point(graph().index(i)); }
+  static const RoadGraph& graph()                  { return ctx().road->graph; }
+  static size_t          roadhash()                { return ctx().road->hash; }
+  static DistInt         basecost(const TripId& i);
+  static Customer        basecust(const TripId& i);  // INITIAL customer (never gets updated; active customers only)
+  static BoundingBox     bbox()                    { return ctx().road->bbox; }
+  static Speed         & vspeed()                  { return ctx().speed; }
+  static SimlTime        now()                     { return ctx().t; }
+  static GTree::G_Tree & gtree()                   { return ctx().road->gtree; }
+  static sqlite3       * db()                      { return ctx().db; }
+  static EventQueue    & events()                  { return ctx().events; }
+  static bool          & paused()                  { return ctx().paused; }
+  static int           & count_sp()                { return ctx().count_sp; }
+  static int           & waiting()                 { return ctx().nwaiting; }  // # unassigned waiting custs (dbmx)
+  static SegmentTable  & segments()                { return ctx().segments; }  // packed routes (dbmx)
+  static StopsVisited    visited(const CustId& i) {  // (dbmx)
+    const size_t k = tidx(i);
+    const vec_t<StopsVisited>& visited = ctx().visited;
+    return (k < visited.size()) ? visited[k] : StopsVisited::Absent;
+  }
+  static std::mutex    & dbmx()                    { return ctx().dbmx; }  // protect the db
+  static std::mutex    & spmx()                    { return ctx().spmx; }  // protect the shortest-paths cache
+  static std::mutex    & scmx()                    { return ctx().scmx; }
+  static std::mutex    & ofmx()                    { return ctx().ofmx; }  // static mode mutex
+  static std::mutex    & pause_mx()                { return ctx().pause_mx; }
+  static std::condition_variable & pause_cv()      { return ctx().pause_cv; }
+  static bool            static_mode()             { return ctx().static_mode; }
+  static bool            strict_mode()             { return ctx().strict_mode; }
+
+  /* The simulation state read by the static accessors is the context bound
+   * to the calling thread. A Cargo binds the thread that constructs it, the
+   * threads it starts, and the calling thread of start(), checkpoint(),
+   * restore() and compile(); other threads that work on a simulation (e.g.
+   * an algorithm's worker pool) bind to it first, with the Cargo's bind() or
+   * with bind(ctx()) on a thread already bound. An RSAlgorithm works on the
+   * simulation bound when it is constructed. An unbound thread reads the
+   * only live simulation; with more than one live, ctx() throws. */
+  static SimContext    & ctx() {
+    if (cur_) return *cur_;
+    if (nlive_ != 1) throw std::logic_error("Cargo::ctx(): no simulation bound to this thread");
+    return *first_.load();
+  }
+  void                   bind()                    { cur_ = &ctx_; }
+  static void            bind(SimContext& sim)     { cur_ = &sim; }
+
+  /* Load a road network (*.rnet path), or share the one already loaded in
+   * this process. A Cargo on the same network made while the returned
+   * pointer is held (also in a child process forked after the call) uses
+   * this copy instead of reading the files again. */
+  static std::shared_ptr<RoadNetwork> load_road(const Filepath &);
+
+  /* Trips are numbered densely in 0..ntrips()-1 when the instance is loaded
+   * (see TripIndex), so per-trip tables can be plain vectors indexed by
+   * tidx(); tid() translates back. An id outside the instance maps to an
+   * index >= ntrips(). */
+  static size_t          tidx(const TripId& i)     { return (size_t)ctx().trips.index(i); }
+  static TripId          tid(const size_t& k)      { return ctx().trips.id.at(k); }
+  static size_t          ntrips()                  { return ctx().trips.size(); }
+
+  /* Schedule the timeout of a customer that is (or becomes) unassigned,
+   * for after its matching period (or the next tick if that has passed).
+   * Call with dbmx held. */
+  static void expire(const CustId &, const ErlyTime &);
 
   void start();                             // start simulation
-  void start(RSAlgorithm &);                // start simulation
+  void start(RSAlgorithm &);                // start (or resume) simulation
+
+  /* What-if branching: run with the algorithm until tick t, then fork n
+   * child processes (copy-on-write) from that state. Returns 1..n in the
+   * children, which continue with start(RSAlgorithm &) and an algorithm or
+   * settings of their choice (its output files must have distinct names);
+   * returns 0 in the parent once the children have exited, leaving its own
+   * simulation at tick t, to be continued the same way or dropped (or
+   * finished, if it ends by t, in which case there are no children).
+   * A branch's "matches" count only its own matches. One simulation per
+   * process (fork() keeps only this thread). */
+  int start(RSAlgorithm &, const SimlTime &, const int &);
   int step(int &);                          // move the vehicles
+  void compile(const Filepath &);           // save compiled problem
 
+  /* Checkpoints (see Options::checkpoint_interval). checkpoint() saves the
+   * simulation as of the end of the current tick: the database into
+   * <path>.db, and the clock, per-trip tables, pending timeouts, metrics,
+   * rng, the algorithm's state (see RSAlgorithm::get_state()) and,
+   * optionally, the shortest-paths cache into path. Call it with dbmx held
+   * (or while not running). restore() loads a checkpoint into a Cargo just
+   * made with the same road network and problem, before start(); the run
+   * resumes at the next tick, with the waiting customers replayed to the
+   * algorithm as arrivals and the .dat and .met files appended to. */
+  void checkpoint(const Filepath &, RSAlgorithm &);
+  void restore(const Filepath &, RSAlgorithm &);
+
+  /* The shortest-paths cache is shared by the simulation's threads; hold
+   * spmx() across a lookup (spexist and spget) and around spput */
   static vec_t<NodeId>                      // get from spcache
   spget(const NodeId& u, const NodeId& v) {
-    return spcache_.get(std::to_string(u)+"|"+std::to_string(v));
+    return ctx().spcache.get(std::to_string(u)+"|"+std::to_string(v));
   }
 
   static void spput(                        // put into spcache
   const NodeId& u, const NodeId& v, vec_t<NodeId>& path) {
-    spcache_.put(std::to_string(u)+"|"+std::to_string(v), path);
+    ctx().spcache.put(std::to_string(u)+"|"+std::to_string(v), path);
   }
 
   static bool                               // check if exists
   spexist(const NodeId& u, const NodeId& v) {
-    return spcache_.exists(std::to_string(u)+"|"+std::to_string(v));
+    return ctx().spcache.exists(std::to_string(u)+"|"+std::to_string(v));
   }
 
   static DistInt
   scget(const NodeId& u, const NodeId& v) {
-    return sccache_.get(std::to_string(u)+"|"+std::to_string(v));
+    return ctx().sccache.get(std::to_string(u)+"|"+std::to_string(v));
   }
 
   static void scput(
   const NodeId& u, const NodeId& v, const DistInt& cost) {
-    sccache_.put(std::to_string(u)+"|"+std::to_string(v), cost);
+    ctx().sccache.put(std::to_string(u)+"|"+std::to_string(v), cost);
   }
 
   static bool
   scexist(const NodeId& u, const NodeId& v) {
-    return sccache_.exists(std::to_string(u)+"|"+std::to_string(v));
+    return ctx().sccache.exists(std::to_string(u)+"|"+std::to_string(v));
   }
 
-  static std::mutex dbmx;                   // protect the db
-  static std::mutex spmx;                   // protect the shortest-paths cache
-  static std::mutex scmx;
-  static std::mutex ofmx;                   // static mode mutex
-  static std::mutex pause_mx;
-  static std::condition_variable pause_cv;
-  static bool static_mode;                  // static mode
-  static bool strict_mode;
-
  private:
   Message print;
 
+  SimContext ctx_;                          // this simulation
+  static thread_local SimContext* cur_;     // bound to the calling thread
+  static std::atomic<SimContext*> first_;   // oldest live simulation
+  static std::atomic<size_t> nlive_;        // # live simulations
+  static vec_t<SimContext*> live_;          // live simulations, oldest first
+  static std::mutex livemx_;                // protect live_
+
+  /* Road networks in use, by path, so that simulations on the same network
+   * share one copy */
+  static std::map<Filepath, std::weak_ptr<RoadNetwork>> roads_;
+  static std::mutex roadmx_;
+
   ProblemSet probset_;
 
+  /* Trips enter the database when t_ reaches their early (admit) and leave
+   * it once they are finished (retire). A text problem is held in trips_;
+   * a compiled problem is read from stream_ as it is admitted. */
+  ProblemStream stream_;                    // compiled problem
+  vec_t<Trip> trips_;                       // text problem, sorted by early
+  vec_t<DistInt> init_costs_;               // base costs (by trips_ idx)
+  vec_t<vec_t<Wayp>> init_rtes_;            // initial routes (by trips_ idx)
+  size_t next_trip_;                        // next trips_ idx to admit
+  bool pop_trip(const SimlTime &, Trip &, DistInt &, vec_t<Wayp> &);
+  void admit();                             // insert appeared trips
+  void retire(const vec_t<CustId> &, CustStatus);
+  void retire(const vec_t<VehlId> &);
+
   SimlTime tmin_;                           // max trip.early
+  bool parking_;                            // idle taxis park (t <= tmin_)
   SimlTime tmax_;                           // max vehicle.late
-  SimlTime matp_;                           // matching pd. (customer timeout)
 
   bool full_sim_;                           // set true for full simulation
 
@@ -122,29 +224,42 @@ class Cargo {
   size_t base_cost_;
   int sleep_interval_;                      // 1 sec/time_multiplier
 
-  /* Global vars */
-  static KVNodes nodes_;                    // nodes_[u] = Point
-  static KVEdges edges_;                    // edges_[u][v] = w
-  static dict<TripId, Customer> customers_;
-  static BoundingBox bbox_;
-  static GTree::G_Tree gtree_;
-  static sqlite3* db_;
-  static Speed speed_;
-  static SimlTime t_;                       // current sim time
-  static bool paused_;
-  static dict<TripId, DistInt> trip_costs_;
-  static cache::lru_cache<std::string, vec_t<NodeId>> spcache_;
-  static cache::lru_cache<std::string, DistInt>       sccache_;
-  static int count_sp_;                     // number of sp computations
+  void expire_due();                        // time out this tick's slot
+  void set_visited(const CustId &, const StopsVisited &);
 
   Speed original_speed_; // hack
 
-  /* Solution file */
-  void total_solution_cost();
-  long int total_traveled_;
-  long int total_penalty_;
+  /* Solution metrics, accumulated as the events happen */
+  void total_solution_cost();               // add custs left unassigned
+  long int total_traveled_;                 // routes of arrived vehicles
+  long int total_penalty_;                  // base costs of unassigned custs
+  long int sum_pickup_delay_;
+  long int sum_trip_delay_;
+  size_t npickups_;
+  size_t ndropoffs_;
+  size_t ntimeouts_;
+  vec_t<SimlTime> pickup_t_;                // pickup times by tidx() (-1 if none)
   SimlDur avg_pickup_delay();               // (time-to-pickup) - cust.early()
   SimlDur avg_trip_delay();                 // (dropoff - pickup) - base cost
+  SimlTime metrics_interval_;               // ticks between snapshots (0=off)
+  void put_metrics(std::ofstream &, const RSAlgorithm &);  // write snapshot
+
+  SimlTime checkpoint_interval_;            // ticks between checkpoints (0=off)
+  bool checkpoint_spcache_;                 // checkpoints include spcache
+  bool resumed_;                            // restored from a checkpoint
+
+  /* Packed-route segments (see segments.h). Replaced and deleted routes
+   * leave theirs in the table until it is reclaimed. */
+  size_t segments_live_;                    // # segments after the last reclaim
+  void reclaim_segments();                  // drop the unused ones (dbmx)
+
+  /* Shortest-paths cache entries, stored as their paths (the key is the
+   * path's ends), least recently used first */
+  void put_spcache(std::ostream &, const size_t &);  // at most # paths
+  void get_spcache(std::istream &);
+  void warm_spcache(const Filepath &, const size_t &);  // # endpoints
+  Filepath spcache_file_;                   // persistent cache (Options)
+  size_t spcache_keep_;
 
   /* Logger containers */
   std::map<VehlId, vec_t<std::pair<NodeId, DistInt>>>  log_v_;
@@ -157,9 +272,7 @@ class Cargo {
   /* SQL statements */
   SqliteReturnCode rc;
   SqliteErrorMessage err;
-  sqlite3_stmt* tim_stmt;                   // timeout customers
   sqlite3_stmt* sac_stmt;                   // select all customers
-  sqlite3_stmt* sar_stmt;                   // select all routes
   sqlite3_stmt* ssv_stmt;                   // select step vehicles
   sqlite3_stmt* ucs_stmt;                   // update cust status
   sqlite3_stmt* uro_stmt;                   // update route, lvn, nnd
@@ -170,10 +283,19 @@ class Cargo {
   sqlite3_stmt* vis_stmt;                   // visitedAt
   sqlite3_stmt* lvn_stmt;                   // last-visited node
   sqlite3_stmt* nnd_stmt;                   // nearest-node dist
-  sqlite3_stmt* stc_stmt;                   // select timed-out customers
   sqlite3_stmt* mov_stmt;                   // bulk-move vehicles
   sqlite3_stmt* usc_stmt;                   // update schedule, lvn, nnd
-  sqlite3_stmt* cwc_stmt;                   // count waiting customers
+  sqlite3_stmt* tmo_stmt;                   // timeout one customer
+  sqlite3_stmt* ive_stmt;                   // insert vehicle
+  sqlite3_stmt* icu_stmt;                   // insert customer
+  sqlite3_stmt* ist_stmt;                   // insert stop
+  sqlite3_stmt* dcu_stmt;                   // delete customer
+  sqlite3_stmt* dve_stmt;                   // delete vehicle
+  sqlite3_stmt* dso_stmt;                   // delete stops
+  sqlite3_stmt* spv_stmt;                   // select parked vehicles
+
+  bool run(RSAlgorithm &, const SimlTime &);  // false if stopped at tick
+  void reseed_events();                     // waiting custs -> Arrive events
 
   void construct(const Options &);
   void initialize(const Options &);
@@ -182,6 +304,48 @@ class Cargo {
   NodeId random_node();
 };
 
+/* A table of values by customer or vehicle id for use in algorithms, in place
+ * of a dict<CustId, T> or dict<VehlId, T>: the values are stored in a vector
+ * by Cargo::tidx(), so a lookup is an array access. The vector is sized for
+ * all the trips on the first insert; clear() only resets the entries set
+ * since the last clear(). at() throws out_of_range if the id has no entry. */
+template <typename T>
+class TripTable {
+ public:
+  T& operator[](const TripId& i) {
+    const size_t k = Cargo::tidx(i);
+    if (k >= Cargo::ntrips()) throw std::out_of_range("TripTable: no such trip");
+    if (slot_.size() != Cargo::ntrips()) slot_.resize(Cargo::ntrips());
+    if (!slot_[k].first) {
+      slot_[k].first = true;
+      ids_.push_back(i);
+    }
+    return slot_[k].second;
+  }
+  T& at(const TripId& i) { return slot_[find(i)].second; }
+  const T& at(const TripId& i) const { return slot_[find(i)].second; }
+  size_t count(const TripId& i) const {
+    const size_t k = Cargo::tidx(i);
+    return (k < slot_.size() && slot_[k].first) ? 1 : 0;
+  }
+  size_t size() const { return ids_.size(); }
+  bool empty() const { return ids_.empty(); }
+  const vec_t<TripId>& ids() const { return ids_; }  // in order of insert
+  void clear() {
+    for (const TripId& i : ids_)
+      slot_[Cargo::tidx(i)] = std::pair<bool, T>();
+    ids_.clear();
+  }
+
+ private:
+  vec_t<std::pair<bool, T>> slot_;          // (has entry, value) by tidx()
+  vec_t<TripId> ids_;
+  size_t find(const TripId& i) const {
+    if (!count(i)) throw std::out_of_range("TripTable::at");
+    return Cargo::tidx(i);
+  }
+};
+
 }  // namespace cargo
 
 #endif  // CARGO_INCLUDE_LIBCARGO_CARGO_H_
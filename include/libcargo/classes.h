@@ -83,11 +83,14 @@ class Stop {
   SimlTime visitedAt_;
 };
 
-/* Schedule is sequence of Stops for Vehicle to follow. ----------------------*/
+/* Schedule is sequence of Stops for Vehicle to follow. ----------------------
+ * The Stops are held in an immutable buffer shared among copies, so copying a
+ * Schedule (or a Vehicle) does not copy the Stops. A new Schedule is made to
+ * change them (see MutableVehicle::set_sch). */
 class Schedule {
  public:
   /* Constructors */
-  Schedule() = default;
+  Schedule();
   Schedule(
     VehlId,      // param1: id of owner
     vec_t<Stop>  // param2: raw sequence of Stops
@@ -102,14 +105,15 @@ class Schedule {
 
  private:
   VehlId owner_;
-  vec_t<Stop> data_;
+  std::shared_ptr<const vec_t<Stop>> data_;
 };
 
-/* Route is sequence of Waypoints for Vehicle to follow. ---------------------*/
+/* Route is sequence of Waypoints for Vehicle to follow. ---------------------
+ * Shares its Waypoints among copies in the same way as Schedule. */
 class Route {
  public:
   /* Constructors */
-  Route() = default;
+  Route();
   Route(
     VehlId,      // param1: id of owner
     vec_t<Wayp>  // param2: raw sequence of Waypoints
@@ -125,7 +129,7 @@ class Route {
 
  private:
   VehlId owner_;
-  vec_t<Wayp> data_;
+  std::shared_ptr<const vec_t<Wayp>> data_;
 };
 
 /* Base class for Customers and Vehicles. ------------------------------------*/
@@ -213,7 +217,8 @@ class Vehicle : public Trip {
     Route,      // vehicle's route
     Schedule,   // vehicle's schedule
     RteIdx,     // index of current node in Route
-    VehlStatus  // status (see types.h)
+    VehlStatus, // status (see types.h)
+    Version = 0 // version of the database row it was read from
   );
   const DistInt    & next_node_distance()    const;  // return next node dist.
   const Route      & route()                 const;  // return Route
@@ -221,6 +226,7 @@ class Vehicle : public Trip {
   const RteIdx     & idx_last_visited_node() const;  // index to last-visit node
   const NodeId     & last_visited_node()     const;  // return last-visit node
   const VehlStatus & status()                const;  // return status
+  const Version    & version()               const;  // return version
         DistInt      traveled()              const;  // return distance traveled
         DistInt      remaining()             const;  // return distance remaining
         Load         queued()                const;  // return number queued
@@ -237,6 +243,7 @@ class Vehicle : public Trip {
   RteIdx idx_last_visited_node_;
   Load queued_;
   VehlStatus status_;
+  Version version_ = 0;
 };
 
 /* Mutable Vehicle. ----------------------------------------------------------*/
@@ -249,11 +256,14 @@ class MutableVehicle : public Vehicle {
   MutableVehicle() = default;
 
   void set_rte(const vec_t<Wayp> &);  // set raw route
+  void set_rte(vec_t<Wayp> &&);       // set raw route (no copy)
   void set_rte(const Route &);        // set Route
   void set_sch(const vec_t<Stop> &);  // set raw schedule
+  void set_sch(vec_t<Stop> &&);       // set raw schedule (no copy)
   void set_sch(const Schedule &);     // set Schedule
   void set_nnd(const DistInt &);      // set distance to next node
   void set_lvn(const RteIdx &);       // set last-visited node index
+  void set_version(const Version &);  // set version
   void reset_lvn();                   // set last-visited node index to 0
   void incr_queued();                 // increase value of queued by 1
   void decr_queued();                 // decrease value of queued by 1
@@ -286,6 +296,17 @@ class ProblemSet {
   dict<SimlTime, vec_t<Trip>> trips_;
 };
 
+/* Snapshot of the database. -------------------------------------------------*/
+/* The vehicles and customers as they were at the end of step t. A snapshot is
+ * never modified once it is taken, so it can be read without locks while the
+ * simulation moves on (see RSAlgorithm::refresh_snapshot). */
+struct Snapshot {
+  SimlTime t;
+  vec_t<Vehicle> vehicles;
+  vec_t<Customer> customers;
+};
+typedef std::shared_ptr<const Snapshot> SnapshotSptr;
+
 std::ostream& operator<<(std::ostream& os, const Wayp &);
 std::ostream& operator<<(std::ostream& os, const vec_t<Wayp> &);
 std::ostream& operator<<(std::ostream& os, const Route &);
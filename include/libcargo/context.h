@@ -0,0 +1,114 @@
+// MIT License
+//
+// Copyright (c) 2018 the Cargo authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef CARGO_INCLUDE_LIBCARGO_CONTEXT_H_
+#define CARGO_INCLUDE_LIBCARGO_CONTEXT_H_
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "classes.h"
+#include "events.h"
+#include "segments.h"
+#include "types.h"
+
+#include "../gtree/gtree.h"
+#include "../lrucache/lrucache.hpp"
+#include "../sqlite3/sqlite3.h"
+
+namespace cargo {
+
+class Logger;
+
+const int LRU_SP_CACHE_SIZE = 1000000;
+const int LRU_SC_CACHE_SIZE = 0;  // <-- not useful in tests
+
+/* Road network: nodes and edges, bounding box, and G-tree index. Loaded once
+ * per process for each road network and shared (read-only) by every
+ * simulation on it; the G-tree is only queried with search() and
+ * find_path(), which do not modify it. */
+struct RoadNetwork {
+  RoadGraph graph;                          // nodes, coordinates, CSR edges
+  BoundingBox bbox;
+  GTree::G_Tree gtree;
+  size_t hash;                              // graph_hash(graph)
+};
+
+/* State of one simulation. Each Cargo owns one; the static Cargo accessors
+ * (Cargo::now(), Cargo::db(), ...) read the context bound to the calling
+ * thread (see Cargo::bind()), so several simulations can run in one process,
+ * each on its own threads, sharing one RoadNetwork. */
+struct SimContext {
+  SimContext()
+      : db(nullptr), speed(0), t(0), paused(false), count_sp(0),
+        spcache(LRU_SP_CACHE_SIZE), sccache(LRU_SC_CACHE_SIZE), matp(0),
+        nwaiting(0), static_mode(false), strict_mode(false),
+        logger(nullptr) {}
+
+  std::shared_ptr<RoadNetwork> road;
+  sqlite3* db;
+  EventQueue events;                        // customer events (to algorithm)
+  Speed speed;
+  SimlTime t;                               // current sim time
+  bool paused;
+  int count_sp;                             // number of sp computations
+  cache::lru_cache<std::string, vec_t<NodeId>> spcache;  // key "orig|dest"
+  cache::lru_cache<std::string, DistInt>       sccache;
+
+  /* Customer timeouts. Slot (due tick % size) of the timing wheel holds the
+   * customers to time out at that tick. A customer is due at most matp+1
+   * ticks ahead, so matp+2 slots never wrap onto a pending tick. */
+  SimlTime matp;                            // matching pd. (customer timeout)
+  vec_t<vec_t<CustId>> wheel;
+  int nwaiting;                             // unassigned waiting customers
+
+  /* Per-trip tables, by Cargo::tidx() */
+  struct RetiredCust {                      // compact record
+    SimlTime early;
+    SimlTime pickup;                        // -1 if never picked up
+    SimlTime dropoff;                       // -1 if never dropped off
+    DistInt cost;
+    bool assigned;
+  };
+  TripIndex trips;                          // trip id <-> tidx()
+  vec_t<DistInt> trip_costs;                // -1 until admitted
+  vec_t<Customer> customers;                // base customers
+  vec_t<RetiredCust> retired;               // finished customers
+  vec_t<StopsVisited> visited;              // customer stops visited (dbmx)
+
+  SegmentTable segments;                    // packed routes (dbmx)
+
+  std::mutex dbmx;                          // protect the db
+  std::mutex spmx;                          // protect the shortest-paths cache
+  std::mutex scmx;
+  std::mutex ofmx;                          // static mode mutex
+  std::mutex pause_mx;
+  std::condition_variable pause_cv;
+  bool static_mode;
+  bool strict_mode;
+
+  Logger* logger;                           // running logger, if any
+};
+
+}  // namespace cargo
+
+#endif  // CARGO_INCLUDE_LIBCARGO_CONTEXT_H_
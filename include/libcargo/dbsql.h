@@ -48,22 +48,39 @@
  *   - swc_stmt  select waiting customers
  *   - sva_stmt  select visited at
  *   - cwc_stmt  count waiting customers
+ *   - sca_stmt  select customer assignment
+ *   - sve_stmt  select vehicle version, nnd
+ *   - spv_stmt  select parked vehicles
+ *   - sir_stmt  select all vehicle ids, routes
  *
  *   UPDATE STATEMENTS
  *   - ucs_stmt  update customer status
  *   - com_stmt  update customer assignment (commit)
  *   - tim_stmt  update timed out customers (set status)
+ *   - tmo_stmt  update one customer to timed out (set status)
  *   - pup_stmt  update vehl. load due to pickup (TODO: see below)
  *   - qud_stmt  update vehl. queued
  *   - drp_stmt  update vehl. load due to dropoff (TODO: see below)
  *   - dav_stmt  update vehl. status (deactivate)
+ *   - upk_stmt  update vehl. status (unpark)
  *   - uro_stmt  update vehl. route, lvn, nnd
+ *   - urb_stmt  update vehl. route blob only (same route)
  *   - sch_stmt  update vehl. schedule
  *   - lvn_stmt  update vehl. last-visited node idex
  *   - nnd_stmt  update vehl. next-node distance
  *   - usc_stmt  update vehl. schedule, lvn, nnd
  *   - mov_stmt  update vehicle position (MOVE VEHICLES)
  *   - vis_stmt  update visited at
+ *
+ *   INSERT STATEMENTS (i--)
+ *   - ive_stmt  insert vehicle
+ *   - icu_stmt  insert customer
+ *   - ist_stmt  insert stop
+ *
+ *   DELETE STATEMENTS (d--)
+ *   - dcu_stmt  delete finished customer
+ *   - dve_stmt  delete finished vehicle
+ *   - dso_stmt  delete stops of a trip
  */
 
 namespace cargo {
@@ -90,10 +107,11 @@ const SqliteQuery create_cargo_tables =
     "load           int not null,"        // col 5
     "queued         int not null,"        // col 6
     "status         int not null,"        // col 7
-    "route          blob not null,"       // col 8
+    "route          blob not null,"       // col 8 (packed; see segments.h)
     "idx_last_visited_node int not null," // col 9
     "next_node_distance int not null,"    // col 10
     "schedule       blob not null,"       // col 11
+    "version        int not null,"        // col 12
   "foreign key (origin_id) references nodes(id),"
   "foreign key (destination_id) references nodes(id)"
   ") without rowid;"
@@ -150,6 +168,7 @@ const SqliteQuery ssv_stmt =  // select stepping vehicles
   "where"
   "  ? >= early"       // param1: early (e_i)
   "  and ? != status"  // param2: VehlStatus::Arrived
+  "  and ? != status"  // param3: VehlStatus::Parked
   "  and next_node_distance <= 0;";
 
 const SqliteQuery smv_stmt =  // select matchable vehicles
@@ -194,6 +213,24 @@ const SqliteQuery cwc_stmt =  // count waiting customers
   "  and ? >= early;";  // param2: time now
 
 
+const SqliteQuery sca_stmt =  // select customer assignment
+  "select assignedTo, status, early from customers "
+  "where"
+  "  id = ?;";  // param1: CustId
+
+const SqliteQuery sve_stmt =  // select vehicle version, nnd
+  "select version, next_node_distance, status from vehicles "
+  "where"
+  "  id = ?;";  // param1: VehlId
+
+const SqliteQuery spv_stmt =  // select parked vehicles
+  "select id, route from vehicles "
+  "where"
+  "  status = ?;";  // param1: VehlStatus::Parked
+
+const SqliteQuery sir_stmt =  // select all vehicle ids, routes
+  "select id, route from vehicles;";
+
 /* Update Customers. ---------------------------------------------------------*/
 const SqliteQuery ucs_stmt =  // update customer status
   "update customers set status = ? "  // param1: CustStatus
@@ -211,6 +248,13 @@ const SqliteQuery tim_stmt =  // update timed out customers
   "  assignedTo is null"
   "  and ? > ? + early;";  // param2: time now; param3: matching period
 
+const SqliteQuery tmo_stmt =  // update one customer to timed out
+  "update customers set status = ? "  // param1: CustStatus::Canceled
+  "where"
+  "  id = ?"              // param2: CustId
+  "  and assignedTo is null"
+  "  and status = ?;";    // param3: CustStatus::Waiting
+
 
 /* Update Vehicles. ----------------------------------------------------------*/
 const SqliteQuery pup_stmt =  // update load due to pickup
@@ -230,17 +274,30 @@ const SqliteQuery drp_stmt =  // update load and queued due to dropoff
   "  id = ?;";  // param1: VehlId
 
 const SqliteQuery dav_stmt =  // update vehicle status (deactivate)
-  "update vehicles set status = ? "
+  "update vehicles set status = ?,"
+  "                    version = version+1 "
   "where"
   "  id = ?;";  // param1: VehlId
 
+const SqliteQuery upk_stmt =  // update vehicle status (unpark)
+  "update vehicles set status = ? "  // param1: VehlStatus::Enroute
+  "where"
+  "  id = ?"            // param2: VehlId
+  "  and status = ?;";  // param3: VehlStatus::Parked
+
 const SqliteQuery uro_stmt =  // update vehicle route, lvn, nnd
   "update vehicles set route = ?,"                  // param1: route blob
   "                    idx_last_visited_node = ?,"  // param2: lvn
-  "                    next_node_distance = ? "     // param3: nnd
+  "                    next_node_distance = ?,"     // param3: nnd
+  "                    version = version+1 "
   "where"
   "  id = ?;";  // param4: VehlId
 
+const SqliteQuery urb_stmt =  // update vehicle route blob (same route)
+  "update vehicles set route = ? "  // param1: route blob
+  "where"
+  "  id = ?;";  // param2: VehlId
+
 const SqliteQuery sch_stmt =  // update vehicle schedule
   "update vehicles set schedule = ? "
   "where"
@@ -259,7 +316,8 @@ const SqliteQuery nnd_stmt =  // update vehicle next-node distance
 const SqliteQuery usc_stmt =  // update vehicle schedule, lvn, nnd
   "update vehicles set schedule = ?,"               // param1: schedule blob
   "                    idx_last_visited_node = ?,"  // param2: lvn
-  "                    next_node_distance = ? "     // param3: nnd
+  "                    next_node_distance = ?,"     // param3: nnd
+  "                    version = version+1 "
   "where"
   "  id = ?;"; // param4: VehlId
 
@@ -268,7 +326,8 @@ const SqliteQuery mov_stmt =  // MOVE VEHICLES
   "         next_node_distance = next_node_distance - ? "  // param1: speed
   "where"
   "  ? >= early"         // param2: time now
-  "  and ? != status;";  // param3: VehlStatus:Arrived
+  "  and ? != status"    // param3: VehlStatus:Arrived
+  "  and ? != status;";  // param4: VehlStatus:Parked
 
 
 /* Update Stops. -------------------------------------------------------------*/
@@ -278,6 +337,38 @@ const SqliteQuery vis_stmt =  // update visited at
   "  owner = ?"           // param2: owner (VehlId or CustId)
   "  and location = ?;";  // param3: stop location
 
+
+/* Insert trips. -------------------------------------------------------------*/
+const SqliteQuery ive_stmt =  // insert vehicle
+  "insert into vehicles values(?,?,?,?,?,?,?,?,?,?,?,?,0);";
+
+const SqliteQuery icu_stmt =  // insert customer
+  "insert into customers values(?, ?, ?, ?, ?, ?, ?, ?);";
+
+const SqliteQuery ist_stmt =  // insert stop
+  "insert into stops values(?, ?, ?, ?, ?, ?);";
+
+
+/* Delete trips. -------------------------------------------------------------*/
+const SqliteQuery dcu_stmt =  // delete finished customer
+  "delete from customers "
+  "where"
+  "  id = ?"            // param1: CustId
+  "  and status = ?;";  // param2: CustStatus::Arrived or Canceled
+
+const SqliteQuery dve_stmt =  // delete finished vehicle
+  "delete from vehicles "
+  "where"
+  "  id = ?"            // param1: VehlId
+  "  and status = ?"    // param2: VehlStatus::Arrived
+  "  and not exists (select id from customers "
+  "                  where customers.assignedTo = vehicles.id);";
+
+const SqliteQuery dso_stmt =  // delete stops of a trip
+  "delete from stops "
+  "where"
+  "  owner = ?;";  // param1: owner (VehlId or CustId)
+
 }  // namespace sql
 }  // namespace cargo
 
@@ -69,7 +69,14 @@ inline DistInt get_shortest_path(
   }
   //------------------------
 
-  if (!Cargo::spexist(u, v)) {
+  // Look up and copy under one lock (another thread may evict the entry);
+  // compute without it
+  bool cached;
+  { std::lock_guard<std::mutex> splock(Cargo::spmx());
+    cached = Cargo::spexist(u, v);
+    if (cached) seg = Cargo::spget(u, v);
+  }
+  if (!cached) {
     // gtree seems to directly cause SIGSEGV if u or v is out of bounds so the
     // try-catch is useless
     try { gtree.find_path(u, v, seg); }
@@ -77,17 +84,9 @@ inline DistInt get_shortest_path(
       std::cout << "gtree.find_path(" << u << "," << v << ") failed" << std::endl;
       throw std::runtime_error("find_path error");
     }
-    // Acquire lock
-    std::lock_guard<std::mutex> splock(Cargo::spmx);
+    std::lock_guard<std::mutex> splock(Cargo::spmx());
     Cargo::spput(u, v, seg);
   }
-  // Lock released (out-of-scope)
-  else {
-    // Acquire lock
-    std::lock_guard<std::mutex> splock(Cargo::spmx);
-    seg = Cargo::spget(u, v);
-  }
-  // Lock released (out-of-scope)
 
   DistInt cost = 0;
   Wayp wp = std::make_pair(cost, seg.at(0));
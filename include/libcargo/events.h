@@ -0,0 +1,73 @@
+// MIT License
+//
+// Copyright (c) 2018 the Cargo authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef CARGO_INCLUDE_LIBCARGO_EVENTS_H_
+#define CARGO_INCLUDE_LIBCARGO_EVENTS_H_
+#include <atomic>
+
+#include "classes.h"
+#include "types.h"
+
+namespace cargo {
+
+/* Customer events, published by the simulation as they happen so that an
+ * algorithm can keep its own set of waiting customers up to date instead of
+ * re-selecting them from the database every batch. */
+enum class CustEventType {
+  Arrive,    // = 0, customer appeared (cust is set)
+  Timeout,   // = 1, customer canceled (not matched within matching period)
+  Pickup,    // = 2
+  Dropoff,   // = 3
+};
+
+struct CustEvent {
+  CustEventType type;
+  CustId id;
+  SimlTime t;                               // time of the event
+  Customer cust;                            // the customer (Arrive only)
+};
+
+/* Unbounded single-producer, single-consumer queue. The producer (the Cargo
+ * thread) and the consumer (the algorithm thread) never wait on each other;
+ * each event is handed over through one atomic pointer. */
+class EventQueue {
+ public:
+  EventQueue();
+  ~EventQueue();
+  EventQueue(const EventQueue &) = delete;
+  EventQueue & operator=(const EventQueue &) = delete;
+
+  void push(const CustEvent &);             // producer only
+  bool pop(CustEvent &);                    // consumer only; false if empty
+  void clear();                             // only while nobody else uses it
+
+ private:
+  struct Node {
+    CustEvent ev;
+    std::atomic<Node*> next;
+  };
+  Node* head_;                              // last consumed (consumer side)
+  Node* tail_;                              // last produced (producer side)
+};
+
+}  // namespace cargo
+
+#endif  // CARGO_INCLUDE_LIBCARGO_EVENTS_H_
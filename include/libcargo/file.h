@@ -22,6 +22,7 @@
 #ifndef CARGO_INCLUDE_LIBCARGO_FILE_H_
 #define CARGO_INCLUDE_LIBCARGO_FILE_H_
 #include <condition_variable>
+#include <cstdint>
 #include <fstream>
 #include <map>
 #include <mutex>
@@ -38,17 +39,84 @@ std::pair<std::string, std::string> parse_road_path(const std::string &);
 Speed parse_speed(const std::string &);
 
 /* These functions throw runtime_errors if the file cannot be read. */
-size_t read_nodes(const Filepath &, KVNodes &);                // return # nodes
-size_t read_nodes(const Filepath &, KVNodes &, BoundingBox &); // output bbox
-size_t read_edges(const Filepath &, KVEdges &);                // return # edges
-size_t read_problem(const Filepath &, ProblemSet &);           // return # trips
+size_t read_nodes(const Filepath &, RoadGraph &);                // return # nodes
+size_t read_nodes(const Filepath &, RoadGraph &, BoundingBox &); // output bbox
+size_t read_edges(const Filepath &, RoadGraph &);                // return # edges
+size_t read_problem(const Filepath &, ProblemSet &);             // return # trips
+void index_trips(vec_t<TripId>, TripIndex &);  // throws if an id repeats
+
+/* Add (or move) a node with no edges, e.g. the special "no destination" node */
+void add_node(RoadGraph &, const NodeId &, const Point &);
+
+/* Binary road graph: a parsed .rnet/.edges pair in one file, loaded with a
+ * single sequential read. The stamp identifies the text files it was made
+ * from (0 if they are absent); read_graph returns false if the file is
+ * missing, malformed (counts that do not match its size, edges out of
+ * range), or was made from different text files. write_graph replaces the
+ * file whole, through a temporary file. */
+size_t graph_stamp(const Filepath &, const Filepath &);  // .rnet, .edges
+bool read_graph(const Filepath &, const size_t &, RoadGraph &, BoundingBox &,
+                size_t &);                                // output # edges
+void write_graph(const Filepath &, const size_t &, const RoadGraph &,
+                 const BoundingBox &, const size_t &);
+size_t graph_hash(const RoadGraph &);  // identifies a road network
+
+/* Compiled problem instance (made by tool/instcompiler): the trips sorted by
+ * early, each with its base cost and, for vehicles, its initial route. The
+ * costs and routes are returned only if the road hash matches the one the
+ * file was compiled against; otherwise they are left empty. */
+bool is_compiled(const Filepath &);
+size_t read_compiled(const Filepath &, const size_t &, ProblemSet &,
+                     vec_t<DistInt> &, vec_t<vec_t<Wayp>> &);  // # trips
+void write_compiled(const Filepath &, const size_t &, ProblemSet &,
+                    const vec_t<Trip> &, const vec_t<DistInt> &,
+                    const vec_t<vec_t<Wayp>> &);
+
+/* Sequential reader over a compiled problem, so that trips can be handed to
+ * the simulation as it reaches them instead of loading the whole instance.
+ * open() reads the header and makes one pass over the trip table to count
+ * it (and collect its ids); next() then returns the trips in order of early,
+ * with the base cost and initial route if has_costs() (the road hash
+ * matches). */
+class ProblemStream {
+ public:
+  ProblemStream();
+
+  void open(const Filepath &, const size_t &, ProblemSet &);  // name, road
+  bool is_open() const;
+  bool has_costs() const;
+
+  size_t size() const;                      // # trips
+  size_t nread() const;                     // # trips returned by next()
+  size_t vehicles() const;                  // # trips with load < 0
+  size_t customers() const;                 // # trips with load > 0
+  ErlyTime max_early() const;
+  LateTime max_late() const;
+  const vec_t<TripId>& ids() const;         // trip ids, in file order
+
+  bool peek(ErlyTime &) const;              // early of the next trip
+  bool next(Trip &, DistInt &, vec_t<Wayp> &);  // false if no more trips
+
+ private:
+  std::ifstream rows_;                      // trip table cursor
+  std::ifstream offs_;                      // route offsets cursor
+  std::ifstream wayps_;                     // route data cursor
+  bool has_costs_;
+  size_t ntrips_, nread_, nvehicles_, ncustomers_;
+  uint64_t off_;                            // offset of the next route
+  ErlyTime max_early_;
+  LateTime max_late_;
+  vec_t<TripId> ids_;
+  int32_t row_[7];                          // next trip (read ahead)
+};
 
 /* Thread-safe Logger for generating solplot.py input
  * The logger is "event-based"; certain events trigger putting different
- * messages into the log file. */
+ * messages into the log file. The put_*_message functions write to the
+ * logger of the simulation bound to the calling thread (SimContext). */
 class Logger {
  public:
-  Logger(const Filepath &);
+  Logger(const Filepath &, bool append = false);  // append: resumed run
   ~Logger();
 
   void run();
@@ -80,9 +148,9 @@ class Logger {
   std::string pop();
 
  private:
-  static std::queue<std::string> queue_;
-  static std::condition_variable condition_;
-  static std::mutex mutex_;
+  std::queue<std::string> queue_;
+  std::condition_variable condition_;
+  std::mutex mutex_;
   std::ofstream file_output_;
   bool done_;
 };
@@ -49,6 +49,27 @@ struct Options {
 
     // Save in-memory database into file when simulation finishs
     Filepath path_to_save = "";
+
+    // Write a snapshot of the solution metrics into <algorithm name>.met
+    // every this many SimTime (0 = no snapshots)
+    SimlTime metrics_interval = 0;
+
+    // Write a checkpoint of the simulation into <algorithm name>.ckpt (and
+    // its database into .ckpt.db) every this many SimTime (0 = none); see
+    // Cargo::restore(). Set checkpoint_spcache to include the shortest-paths
+    // cache, so that a restored run starts warm.
+    SimlTime checkpoint_interval = 0;
+    bool checkpoint_spcache = false;
+
+    // Shortest-paths cache file. If set, the cache starts with the paths
+    // saved in it (if they were saved on the same road network), and the
+    // spcache_keep most recently used paths are saved into it at the end.
+    Filepath path_to_spcache = "";
+    size_t spcache_keep = 100000;
+
+    // Before starting, compute the paths between each pair of the N most
+    // frequent trip origins and destinations, N = spcache_warmup (0 = none)
+    size_t spcache_warmup = 0;
 };
 
 } // namespace cargo
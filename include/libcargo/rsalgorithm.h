@@ -21,6 +21,12 @@
 // SOFTWARE.
 #ifndef CARGO_INCLUDE_LIBCARGO_RSALGORITHM_H_
 #define CARGO_INCLUDE_LIBCARGO_RSALGORITHM_H_
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <string>
 #include <unordered_set>
@@ -61,12 +67,23 @@ class RSAlgorithm {
         void          kill();        // set done_ to true
 
         void          select_waiting_customers(bool skip_assigned = true, bool skip_delayed = true); // populate customers_
-        void          select_matchable_vehicles(); // populate vehicles_
+        void          select_matchable_vehicles(); // populate vehicles_ (from snapshot)
 
   vec_t<Vehicle>    & vehicles();           // return vehicles_
   vec_t<Customer>   & customers();          // return customers_
-  vec_t<Vehicle>      get_all_vehicles();   // populate & return ALL vehicles
-  vec_t<Customer>     get_all_customers();  // populate & return ALL customers
+  vec_t<Vehicle>      get_all_vehicles();   // refresh snapshot & return ALL vehicles
+  vec_t<Customer>     get_all_customers();  // refresh snapshot & return ALL customers
+
+  /* Snapshots (see classes.h). listen() refreshes the snapshot once per
+   * batch. While Cargo is running, refreshing asks it for a new snapshot and
+   * waits for the end of the current step. Cargo takes the snapshot on its
+   * own thread between steps, so reading the fleet never holds dbmx during a
+   * long batch. Otherwise (or in static mode, where the simulation waits for
+   * the algorithm anyway) the algorithm reads the database itself. */
+  const SnapshotSptr& snapshot() const;     // the current snapshot
+        void          refresh_snapshot();   // get a new one
+        void          publish_snapshot();   // (Cargo) take one if asked
+        void          live_snapshots(bool); // (Cargo) set if Cargo publishes
         bool          delay(const CustId &); // true if customer under delay
         bool          timeout(const tick_t &); // true if tick_t > timeout_
 
@@ -91,9 +108,31 @@ class RSAlgorithm {
           MutableVehicle &);
 //        bool strict = false);
 
+  /* Queue an assignment to be committed at the next tick boundary. The
+   * assignment is planned here, on the caller's thread; Cargo commits all
+   * the queued assignments in one transaction, rejecting any whose vehicle
+   * changed since it was planned. The result comes back through the future
+   * and, if given, the callback; callbacks run on the algorithm thread at
+   * the start of the next listen(), with the synchronized vehicle. */
+  std::future<bool> assign_later(
+    const vec_t<CustId> &,
+    const vec_t<CustId> &,
+    const vec_t<Wayp>   &,
+    const vec_t<Stop>   &,
+    const MutableVehicle &,
+    std::function<void(bool, MutableVehicle &)> = nullptr);
+
+  void commit_queued();                     // commit queued assignments
+
   void beg_delay(const CustId &);           // begin delaying a customer
   void end_delay(const CustId &);           // end delaying a customer
 
+  /* State kept in a checkpoint (see Cargo::checkpoint()): matches,
+   * rejected, and the delays. An algorithm's own state (e.g. its rng) is
+   * not part of it. */
+  void get_state(int &, int &, vec_t<SimlTime> &);
+  void set_state(const int &, const int &, const vec_t<SimlTime> &);
+
   Message print;                            // print stream
 
   void print_statistics();                  // print statistics
@@ -118,7 +157,8 @@ class RSAlgorithm {
   vec_t<int> n_cust_per_batch_;
   vec_t<int> n_vehl_per_batch_;
 
-  dict<CustId, SimlTime> delay_;
+  vec_t<SimlTime> delay_;                   // delay start, by Cargo::tidx()
+  std::mutex dlmx_;                         // protects delay_ (checkpoints)
 
   int retry_;                               // delay interval
   int timeout_;                             // timeout limit (ms)
@@ -136,6 +176,60 @@ class RSAlgorithm {
 
   vec_t<Customer> customers_;               // get with customers()
   vec_t<Vehicle>  vehicles_;                // get with vehicles()
+  std::map<CustId, Customer> waiting_;      // appeared, not yet picked up
+
+  typedef enum {                            // used interally for sync()
+    SUCCESS,
+    INVALID_VEHICLE,
+    CURLOC_MISMATCH,
+    PREFIX_MISMATCH,
+    CADD_SYNC_FAIL,
+    CDEL_SYNC_FAIL
+  } SyncResult;
+
+  /* assign() works in phases: read_vehl() under dbmx, plan() (sync and
+   * re-route) without it, then check_version() and apply() under dbmx if
+   * the vehicle's version is unchanged, or plan again (up to max_tries_
+   * times) if not. Nothing is routed while dbmx is held. */
+  struct VehlState {                        // used internally for assign()
+    int curcap;                             // current capacity
+    vec_t<Wayp> rte;                        // current route
+    vec_t<Stop> sch;                        // current schedule
+    RteIdx lvn;                             // last-visited node index
+    DistInt nnd;                            // distance to next node
+    Version version;                        // row version (see types.h)
+    SyncResult visited;                     // check_visited() of the custs
+  };
+
+  struct QueuedAssign {                     // used internally for assign_later()
+    vec_t<CustId> cadd, cdel;
+    vec_t<Wayp> rte;
+    vec_t<Stop> sch;
+    MutableVehicle vehl;
+    bool planned;                           // plan() succeeded
+    VehlState state;                        // vehicle the plan was made on
+    vec_t<Wayp> out_rte;                    // synced route
+    vec_t<Stop> out_sch;                    // synced schedule
+    bool result;
+    std::promise<bool> promise;
+    std::function<void(bool, MutableVehicle &)> callback;
+  };
+  typedef std::shared_ptr<QueuedAssign> QueuedAssignSptr;
+  std::mutex qmx_;                          // protects queued_, committed_
+  vec_t<QueuedAssignSptr> queued_;          // waiting for commit_queued()
+  vec_t<QueuedAssignSptr> committed_;       // waiting for the algorithm
+  void note_assigned(                       // update waiting_
+    const vec_t<CustId> &,
+    const vec_t<CustId> &,
+    const VehlId        &);
+
+  SnapshotSptr snapshot_;                   // get with snapshot()
+  SnapshotSptr published_;                  // set by publish_snapshot()
+  std::mutex snmx_;                         // protects published_, live_, want_
+  std::condition_variable sncv_;            // signals published_
+  bool live_;                               // Cargo publishes snapshots
+  bool want_;                               // waiting for a snapshot
+  void read_snapshot(Snapshot &);           // from the database
 
   SqliteReturnCode rc;
   sqlite3_stmt* ssr_stmt;                   // select route
@@ -144,27 +238,52 @@ class RSAlgorithm {
   sqlite3_stmt* sch_stmt;                   // update sched
   sqlite3_stmt* qud_stmt;                   // increase queued
   sqlite3_stmt* com_stmt;                   // assign cust to veh
-  sqlite3_stmt* smv_stmt;                   // select matchable vehicles
   sqlite3_stmt* sav_stmt;                   // select all vehicles
-  sqlite3_stmt* swc_stmt;                   // select waiting customers
   sqlite3_stmt* sac_stmt;                   // select all customers
   sqlite3_stmt* svs_stmt;                   // select vehicle status
   sqlite3_stmt* sov_stmt;                   // select one vehicle
-  sqlite3_stmt* sva_stmt;                   // select stop visitedAt
-
-  typedef enum {                            // used interally for sync()
-    SUCCESS,
-    INVALID_VEHICLE,
-    CURLOC_MISMATCH,
-    PREFIX_MISMATCH,
-    CADD_SYNC_FAIL,
-    CDEL_SYNC_FAIL
-  } SyncResult;
+  sqlite3_stmt* sca_stmt;                   // select cust assignment
+  sqlite3_stmt* sve_stmt;                   // select vehicle version
+  sqlite3_stmt* upk_stmt;                   // unpark vehicle
 
   int duration(const tick_t& t_0, const tick_t& t_1) {
     return std::round(dur_milli(t_1 - t_0).count());
   }
 
+  static const int max_tries_ = 3;
+  bool read_vehl(                           // false if not active
+    const VehlId        &,
+    const vec_t<CustId> &,                  // custs to add
+    const vec_t<CustId> &,                  // custs to del
+          VehlState     &);
+  bool check_version(                       // false if not active
+    const VehlId        &,
+    const vec_t<CustId> &,                  // custs to add
+    const vec_t<CustId> &,                  // custs to del
+          VehlState     &,                  // nnd refreshed if current
+          bool          &);                 // output true if current
+  bool plan(
+    const VehlState     &,
+    const vec_t<CustId> &,                  // custs to add
+    const vec_t<Wayp>   &,
+    const vec_t<Stop>   &,
+    const MutableVehicle &,
+          vec_t<Wayp>   &,                  // synced route
+          vec_t<Stop>   &);                 // synced schedule
+  bool apply(
+    const VehlState     &,
+    const vec_t<CustId> &,
+    const vec_t<CustId> &,
+    const vec_t<Wayp>   &,
+    const vec_t<Stop>   &,
+          MutableVehicle &);
+  bool commit_planned(QueuedAssign &);      // check and apply, dbmx held
+  void run_callbacks();                     // finish committed_
+
+  SyncResult check_visited(                 // stops of cadd/cdel visited?
+    const vec_t<CustId> &,
+    const vec_t<CustId> &);
+
   SyncResult sync(                          // internal function
     const vec_t<Wayp>   & new_rte,
     const vec_t<Wayp>   & cur_rte,
@@ -172,7 +291,8 @@ class RSAlgorithm {
     const vec_t<Stop>   & new_sch,
     const vec_t<Stop>   & cur_sch,
     const vec_t<CustId> & cadd,
-    const vec_t<CustId> & cdel,
+    const SyncResult    & visited,
+    const bool          & fresh,            // vehl version matches cur
           vec_t<Wayp>   & out_rte,
           vec_t<Stop>   & out_sch);
 };
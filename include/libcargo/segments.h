@@ -0,0 +1,89 @@
+// MIT License
+//
+// Copyright (c) 2018 the Cargo authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef CARGO_INCLUDE_LIBCARGO_SEGMENTS_H_
+#define CARGO_INCLUDE_LIBCARGO_SEGMENTS_H_
+#include <cstdint>
+
+#include "classes.h"
+#include "types.h"
+
+namespace cargo {
+
+/* Vehicle routes are stored in the database packed, as runs over interned
+ * path segments instead of full waypoint lists. A route made by
+ * route_through is the concatenation of the shortest paths between
+ * consecutive stops of its schedule; each of these paths is interned once
+ * (keyed by its end nodes) and the route keeps only a reference to it.
+ * Waypoints that are not part of such a path (e.g. the last-visited node
+ * kept in front by RSAlgorithm::sync) are stored as single-waypoint runs. */
+typedef int SegId;
+
+struct RteRun {
+  int32_t idx;                              // index of its first waypoint
+  int32_t ref;                              // SegId, or -1-NodeId (single)
+  DistInt base;                             // distance at its first waypoint
+};
+
+/* Interned segments. A segment's waypoints are relative to its first one.
+ * Segments stay until reclaim() drops the ones no route uses. Not
+ * thread-safe: the table is part of the database state and is used with
+ * Cargo::dbmx() held. */
+class SegmentTable {
+ public:
+  /* The runs of a route; the last run is always a single waypoint. The
+   * schedule gives the segment boundaries. */
+  void pack(const vec_t<Wayp> &, const vec_t<Stop> &, vec_t<RteRun> &);
+  void unpack(const RteRun *, const size_t &, vec_t<Wayp> &) const;
+  const vec_t<Wayp> & segment(const SegId &) const;
+  size_t size() const;                      // # segments
+  void clear();
+  void add(const vec_t<Wayp> &);            // append as the next SegId (restore)
+  /* Keep only the segments the routes use and renumber their runs. The
+   * routes must be all of the routes packed with this table. */
+  void reclaim(vec_t<vec_t<RteRun>> &);
+
+ private:
+  vec_t<vec_t<Wayp>> segments_;
+  dict<NodeId, dict<NodeId, SegId>> index_; // from, to -> segment
+  SegId intern(vec_t<Wayp>::const_iterator, vec_t<Wayp>::const_iterator);
+};
+
+/* Read-only view of a packed route (e.g. a column blob), expanding only the
+ * waypoints that are read. Valid while the blob and the table are. */
+class PackedRoute {
+ public:
+  PackedRoute(const SegmentTable &, const void *, const size_t &);  // bytes
+  size_t  size() const;                     // # waypoints
+  Wayp    at(const RteIdx &) const;
+  DistInt cost() const;                     // distance at the last waypoint
+  void    unpack(vec_t<Wayp> &) const;
+
+ private:
+  const SegmentTable & table_;
+  const RteRun* runs_;
+  size_t nruns_;
+  mutable size_t hint_;                     // run of the last at()
+};
+
+}  // namespace cargo
+
+#endif  // CARGO_INCLUDE_LIBCARGO_SEGMENTS_H_
@@ -23,7 +23,10 @@
 #define CARGO_INCLUDE_LIBCARGO_TYPES_H_
 
 #include <chrono>
+#include <cstdint>
 #include <limits>
+#include <stdexcept>
+#include <string>
 #include <unordered_map>
 #include <vector>
 #include <utility> /* std::pair */
@@ -88,10 +91,19 @@ enum class CustStatus {
   Canceled,  // = 3
 };
 
+// Stops of a customer visited so far (see Cargo::visited)
+enum class StopsVisited : uint8_t {
+  Absent,  // = 0 (customer not in the database)
+  None,    // = 1
+  Orig,    // = 2
+  Both,    // = 3
+};
+
 enum class VehlStatus {
   Waiting,  // = 0
   Enroute,  // = 1
   Arrived,  // = 2
+  Parked,   // = 3 (idle taxi at its destination; not moved or stepped)
 };
 
 typedef int Load;  // positive=customer, negative=vehicle
@@ -101,14 +113,65 @@ typedef std::pair<DistInt, NodeId> Wayp;
 typedef size_t RteIdx;
 typedef size_t SchIdx;
 
-// Lookup nodes.
-typedef dict<NodeId, Point> KVNodes;
+typedef int Version;  // bumped whenever a vehicle's route or schedule changes
+
+// Road network in compressed sparse row (CSR) form. Original node ids are
+// remapped to dense indices 0..size()-1; the original ids are kept in id[] and
+// translated back through index(). The edges out of dense node i are stored in
+// dst[off[i]..off[i+1]) and wgt[off[i]..off[i+1]); the graph is "undirected",
+// so every edge is stored once in each direction. Usage:
+//     RoadGraph g;
+//     Point p = g.point(g.index(id));
+//     DistDbl w = g.weight(g.index(from_id), g.index(to_id));
+struct RoadGraph {
+  NodeId         base = 0;  // smallest original id
+  vec_t<int>     dense;     // dense[id-base] = dense index, or -1
+  vec_t<NodeId>  id;        // id[i]  = original id of dense node i
+  vec_t<Lon>     lng;       // lng[i] = longitude of dense node i
+  vec_t<Lat>     lat;       // lat[i] = latitude of dense node i
+  vec_t<int>     off;       // off[i] = first edge of dense node i
+  vec_t<int>     dst;       // dst[e] = dense head of edge e
+  vec_t<DistDbl> wgt;       // wgt[e] = weight of edge e
+
+  size_t size() const { return id.size(); }
+
+  // Dense index of an original id; -1 if the id is not in the graph
+  int index(const NodeId& u) const {
+    const long k = (long)u - base;
+    return (k < 0 || k >= (long)dense.size()) ? -1 : dense[k];
+  }
+
+  Point point(const int& i) const { return {lng.at(i), lat.at(i)}; }
+
+  // Throws out_of_range if (i, j) is not an edge
+  DistDbl weight(const int& i, const int& j) const {
+    if (i == j && i >= 0) return 0;
+    if (i < 0 || (size_t)i + 1 >= off.size()) throw std::out_of_range("edge");
+    for (int e = off[i]; e < off[i+1]; ++e)
+      if (dst[e] == j) return wgt[e];
+    throw std::out_of_range("edge");
+  }
+};
 
-// Lookup edges.  The key-value store is "undirected"; that is, from-to and
-// to-from key combinations both exist in the store. Usage:
-//     KVEdges em_;
-//     em[from_id][to_id] = weight;
-typedef dict<NodeId, dict<NodeId, DistDbl>> KVEdges;
+// Trip ids remapped to dense indices 0..size()-1 (in increasing id order), so
+// that per-trip tables can be vectors. The table spans the smallest to the
+// largest id, as for RoadGraph, so the ids need not be consecutive. Usage:
+//     TripIndex T;
+//     DistInt c = costs.at(T.index(id));
+//     TripId id = T.id.at(i);
+struct TripIndex {
+  TripId        base = 0;   // smallest trip id
+  vec_t<int>    dense;      // dense[id-base] = dense index, or -1
+  vec_t<TripId> id;         // id[i] = trip id of dense index i
+
+  size_t size() const { return id.size(); }
+
+  // Dense index of a trip id; -1 if the id is not in the instance
+  int index(const TripId& t) const {
+    const long k = (long)t - base;
+    return (k < 0 || k >= (long)dense.size()) ? -1 : dense[k];
+  }
+};
 
 // Filepath
 typedef std::string Filepath;
@@ -20,6 +20,7 @@ class lru_cache {
 public:
 	typedef typename std::pair<key_t, value_t> key_value_pair_t;
 	typedef typename std::list<key_value_pair_t>::iterator list_iterator_t;
+	typedef typename std::list<key_value_pair_t>::const_iterator const_iterator;
 
 	lru_cache(size_t max_size) :
 		_max_size(max_size) {
@@ -59,6 +60,20 @@ public:
 	size_t size() const {
 		return _cache_items_map.size();
 	}
+
+	void clear() {
+		_cache_items_map.clear();
+		_cache_items_list.clear();
+	}
+
+	// items from the most to the least recently used
+	const_iterator begin() const {
+		return _cache_items_list.begin();
+	}
+
+	const_iterator end() const {
+		return _cache_items_list.end();
+	}
 	
 private:
 	std::list<key_value_pair_t> _cache_items_list;
@@ -19,25 +19,38 @@
 // LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdio>
 #include <exception>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <mutex>
 #include <random>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <thread>
 
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include "libcargo/cargo.h"
 #include "libcargo/classes.h"
+#include "libcargo/context.h"
 #include "libcargo/debug.h"
+#include "libcargo/distance.h"
 #include "libcargo/dbsql.h"
+#include "libcargo/events.h"
 #include "libcargo/file.h"
 #include "libcargo/functions.h"
 #include "libcargo/message.h"
 #include "libcargo/options.h"
 #include "libcargo/rsalgorithm.h"
+#include "libcargo/segments.h"
 #include "libcargo/types.h"
 
 #include "gtree/gtree.h"
@@ -45,61 +58,123 @@
 
 namespace cargo {
 
-/* Set the size (number of elements) of the shortest-paths cache */
-const int LRU_SP_CACHE_SIZE = 1000000;
-const int LRU_SC_CACHE_SIZE = 0;  // <-- not useful in tests
-
-/* Initialize global vars */
-/* Containers for quick node/edge lookup */
-KVNodes Cargo::nodes_ = {};
-KVEdges Cargo::edges_ = {};
-
-/* Base trip costs (shortest-path dist from origin to dest) */
-dict<TripId, DistInt> Cargo::trip_costs_ = {};
+/* Simulation contexts (see Cargo::ctx()) */
+thread_local SimContext* Cargo::cur_ = nullptr;
+std::atomic<SimContext*> Cargo::first_(nullptr);
+std::atomic<size_t> Cargo::nlive_(0);
+vec_t<SimContext*> Cargo::live_ = {};
+std::mutex Cargo::livemx_;
+
+/* Loaded road networks */
+std::map<Filepath, std::weak_ptr<RoadNetwork>> Cargo::roads_;
+std::mutex Cargo::roadmx_;
+
+/* Checkpoints and the shortest-paths cache are binary files */
+static const char CHECKPOINT_MAGIC[8] = {'C','A','R','G','O','C','K','2'};
+static const char SPCACHE_MAGIC[8]    = {'C','A','R','G','O','S','P','1'};
+
+/* The segment table is reclaimed when it has doubled since the last time,
+ * but not below this size */
+static const size_t RECLAIM_MIN_SEGMENTS = 10000;
+
+/* Plain values, and vectors of them, as raw bytes (a vector with its size) */
+template <typename T>
+static void bin_put(std::ostream& os, const T& x) {
+  os.write(reinterpret_cast<const char*>(&x), sizeof(T));
+}
 
-/* Base customers */
-dict<TripId, Customer> Cargo::customers_ = {};
+template <typename T>
+static void bin_put(std::ostream& os, const vec_t<T>& v) {
+  bin_put(os, (uint64_t)v.size());
+  os.write(reinterpret_cast<const char*>(v.data()), v.size()*sizeof(T));
+}
 
-/* Bounding box (needed by grid index) */
-BoundingBox Cargo::bbox_ = {{}, {}};
+static void bin_put(std::ostream& os, const std::string& str) {
+  bin_put(os, (uint64_t)str.size());
+  os.write(str.data(), str.size());
+}
 
-/* Global GTree (needed by shortest-path finding functions) */
-GTree::G_Tree Cargo::gtree_ = GTree::get();
+template <typename T>
+static void bin_get(std::istream& is, T& x) {
+  if (!is.read(reinterpret_cast<char*>(&x), sizeof(T)))
+    throw std::runtime_error("binary file truncated");
+}
 
-/* Global database pointer */
-sqlite3* Cargo::db_ = nullptr;
+template <typename T>
+static void bin_get(std::istream& is, vec_t<T>& v) {
+  uint64_t n;
+  bin_get(is, n);
+  v.resize(n);
+  if (n > 0 && !is.read(reinterpret_cast<char*>(v.data()), n*sizeof(T)))
+    throw std::runtime_error("binary file truncated");
+}
 
-/* Global vehicle speed and simulation time (needed for some computations) */
-Speed Cargo::speed_ = 0;
-SimlTime Cargo::t_ = 0;
+static void bin_get(std::istream& is, std::string& str) {
+  uint64_t n;
+  bin_get(is, n);
+  str.resize(n);
+  if (n > 0 && !is.read(&str[0], n))
+    throw std::runtime_error("binary file truncated");
+}
 
-bool Cargo::paused_ = false;
-int Cargo::count_sp_ = 0;
+/* Copy database src over dst (sqlite3 backup API) */
+static int copy_db(sqlite3* dst, sqlite3* src) {
+  sqlite3_backup* p_backup = sqlite3_backup_init(dst, "main", src, "main");
+  if (!p_backup) return sqlite3_errcode(dst);
+  sqlite3_backup_step(p_backup, -1);
+  return sqlite3_backup_finish(p_backup);
+}
 
-/* Global mutexes */
-std::mutex Cargo::dbmx;
-std::mutex Cargo::spmx;
-std::mutex Cargo::scmx;
-std::mutex Cargo::ofmx;
-std::mutex Cargo::pause_mx;
-std::condition_variable Cargo::pause_cv;
-bool Cargo::static_mode = false;
-bool Cargo::strict_mode = false;
+/* Read the id and route blob of every vehicle in db */
+static int get_routes(sqlite3* db, vec_t<VehlId>& ids,
+                      vec_t<vec_t<RteRun>>& routes) {
+  sqlite3_stmt* stmt;
+  int rc = sqlite3_prepare_v2(db, sql::sir_stmt, -1, &stmt, NULL);
+  if (rc != SQLITE_OK) return rc;
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    const RteRun* buf = static_cast<const RteRun*>(sqlite3_column_blob(stmt, 1));
+    ids.push_back(sqlite3_column_int(stmt, 0));
+    routes.emplace_back(buf, buf + sqlite3_column_bytes(stmt, 1) / sizeof(RteRun));
+  }
+  sqlite3_finalize(stmt);
+  return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
 
-/* Shortest-paths cache: hash is stringified orig/dest pair */
-cache::lru_cache<std::string, vec_t<NodeId>> Cargo::spcache_(LRU_SP_CACHE_SIZE);
-cache::lru_cache<std::string, DistInt>       Cargo::sccache_(LRU_SC_CACHE_SIZE);
+/* Overwrite the route blobs of the vehicles in db (versions unchanged) */
+template <typename T>
+static int put_routes(sqlite3* db, const vec_t<VehlId>& ids,
+                      const vec_t<vec_t<T>>& routes) {
+  sqlite3_stmt* stmt;
+  int rc = sqlite3_prepare_v2(db, sql::urb_stmt, -1, &stmt, NULL);
+  if (rc != SQLITE_OK) return rc;
+  sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+  for (size_t i = 0; i < ids.size() && rc == SQLITE_OK; ++i) {
+    sqlite3_bind_blob(stmt, 1, static_cast<void const*>(routes[i].data()),
+                      routes[i].size()*sizeof(T), SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, 2, ids[i]);
+    rc = (sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : sqlite3_errcode(db));
+    sqlite3_clear_bindings(stmt);
+    sqlite3_reset(stmt);
+  }
+  sqlite3_exec(db, "END", NULL, NULL, NULL);
+  sqlite3_finalize(stmt);
+  return rc;
+}
 
 /* Cargo class constructor */
 Cargo::Cargo() { Options _; this->construct(_); }
 Cargo::Cargo(const Options& opt) : print("cargo") { this->construct(opt); }
 void Cargo::construct(const Options& opt) {
   print << "Initializing Cargo" << std::endl;
+  bind();
+  { std::lock_guard<std::mutex> lock(livemx_);
+    live_.push_back(&ctx_);
+    first_ = live_.front();
+    nlive_ = live_.size();
+  }
   rng.seed(std::random_device()());  // used for random_node
   this->initialize(opt);  // loads data into the db
-  prepare_stmt(sql::tim_stmt, &tim_stmt);
   prepare_stmt(sql::sac_stmt, &sac_stmt);
-  prepare_stmt(sql::sar_stmt, &sar_stmt);
   prepare_stmt(sql::ssv_stmt, &ssv_stmt);
   prepare_stmt(sql::ucs_stmt, &ucs_stmt);
   prepare_stmt(sql::uro_stmt, &uro_stmt);
@@ -109,20 +184,24 @@ void Cargo::construct(const Options& opt) {
   prepare_stmt(sql::drp_stmt, &drp_stmt);
   prepare_stmt(sql::vis_stmt, &vis_stmt);
   prepare_stmt(sql::lvn_stmt, &lvn_stmt);
-  prepare_stmt(sql::stc_stmt, &stc_stmt);
   prepare_stmt(sql::nnd_stmt, &nnd_stmt);
   prepare_stmt(sql::mov_stmt, &mov_stmt);
   prepare_stmt(sql::usc_stmt, &usc_stmt);
-  prepare_stmt(sql::cwc_stmt, &cwc_stmt);
+  prepare_stmt(sql::tmo_stmt, &tmo_stmt);
+  prepare_stmt(sql::ive_stmt, &ive_stmt);
+  prepare_stmt(sql::icu_stmt, &icu_stmt);
+  prepare_stmt(sql::ist_stmt, &ist_stmt);
+  prepare_stmt(sql::dcu_stmt, &dcu_stmt);
+  prepare_stmt(sql::dve_stmt, &dve_stmt);
+  prepare_stmt(sql::dso_stmt, &dso_stmt);
+  prepare_stmt(sql::spv_stmt, &spv_stmt);
   print(MessageType::Success) << "Cargo initialized!" << std::endl;
 }
 
 /* Destructor:
  * Need to finalize every stmt and close the db */
 Cargo::~Cargo() {
-  sqlite3_finalize(tim_stmt);
   sqlite3_finalize(sac_stmt);
-  sqlite3_finalize(sar_stmt);
   sqlite3_finalize(ssv_stmt);
   sqlite3_finalize(ucs_stmt);
   sqlite3_finalize(uro_stmt);
@@ -133,36 +212,371 @@ Cargo::~Cargo() {
   sqlite3_finalize(vis_stmt);
   sqlite3_finalize(lvn_stmt);
   sqlite3_finalize(nnd_stmt);
-  sqlite3_finalize(stc_stmt);
   sqlite3_finalize(mov_stmt);
   sqlite3_finalize(usc_stmt);
-  sqlite3_finalize(cwc_stmt);
-
-  // NOTE: This only saves a snapshot of the final state
+  sqlite3_finalize(tmo_stmt);
+  sqlite3_finalize(ive_stmt);
+  sqlite3_finalize(icu_stmt);
+  sqlite3_finalize(ist_stmt);
+  sqlite3_finalize(dcu_stmt);
+  sqlite3_finalize(dve_stmt);
+  sqlite3_finalize(dso_stmt);
+  sqlite3_finalize(spv_stmt);
+
+  // NOTE: This only saves a snapshot of the final state (see checkpoint())
+  /* The segments are not in the database, so the saved routes are the
+   * unpacked waypoint lists */
   if (database_file_ != "") {
-    int rc;
     sqlite3 *p_file;
-    sqlite3_backup *p_backup;
-    rc = sqlite3_open(database_file_.c_str(), &p_file);
-    if (rc == SQLITE_OK) {
-      p_backup = sqlite3_backup_init(p_file, "main", db_, "main");
-      if (p_backup) {
-          sqlite3_backup_step(p_backup, -1);
-          sqlite3_backup_finish(p_backup);
-      }
-      rc = sqlite3_errcode(p_file);
+    vec_t<VehlId> ids;
+    vec_t<vec_t<RteRun>> routes;
+    if (sqlite3_open(database_file_.c_str(), &p_file) == SQLITE_OK
+     && copy_db(p_file, ctx_.db) == SQLITE_OK
+     && get_routes(p_file, ids, routes) == SQLITE_OK) {
+      vec_t<vec_t<Wayp>> rtes(routes.size());
+      for (size_t i = 0; i < routes.size(); ++i)
+        ctx_.segments.unpack(routes[i].data(), routes[i].size(), rtes[i]);
+      if (put_routes(p_file, ids, rtes) != SQLITE_OK)
+        print(MessageType::Warning) << "Could not unpack routes in " << database_file_ << "\n";
     }
     sqlite3_close(p_file);
   }
 
+  /* Save the most recently used shortest paths for the next run on this
+   * network (through a temporary file, as simulations may end together,
+   * also in one process) */
+  if (spcache_file_ != "") {
+    static std::atomic<unsigned> nsaves(0);
+    const Filepath tmp = spcache_file_ + ".tmp" + std::to_string(getpid())
+                       + "." + std::to_string(nsaves++);
+    std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+    const uint64_t hash = ctx_.road->hash;
+    ofs.write(SPCACHE_MAGIC, sizeof(SPCACHE_MAGIC));
+    bin_put(ofs, hash);
+    put_spcache(ofs, spcache_keep_);
+    ofs.close();
+    if (!ofs.good() || std::rename(tmp.c_str(), spcache_file_.c_str()) != 0) {
+      print(MessageType::Warning) << "Could not save shortest-paths cache " << spcache_file_ << "\n";
+      std::remove(tmp.c_str());
+    } else {
+      print << "Saved shortest-paths cache (" << spcache_file_ << ")" << std::endl;
+    }
+  }
+
   if (err != NULL) sqlite3_free(err);
-  sqlite3_close(db_);
+  sqlite3_close(ctx_.db);
   print << "Database closed." << std::endl;
+
+  if (cur_ == &ctx_) cur_ = nullptr;
+  { std::lock_guard<std::mutex> lock(livemx_);
+    live_.erase(std::find(live_.begin(), live_.end(), &ctx_));
+    first_ = (live_.empty() ? nullptr : live_.front());
+    nlive_ = live_.size();
+  }
 }
 
 const std::string & Cargo::name()         { return probset_.name(); }
 const std::string & Cargo::road_network() { return probset_.road_network(); }
 
+/* The per-trip tables are sized once in initialize() and each entry is
+ * written once, in admit(), before the trip is published to the algorithm
+ * (event queue or database), so reads need no lock. Retired customers keep
+ * their entries. */
+DistInt Cargo::basecost(const TripId& i) {
+  const DistInt cost = ctx().trip_costs.at(tidx(i));
+  if (cost == -1) throw std::out_of_range("basecost: trip not admitted");
+  return cost;
+}
+
+Customer Cargo::basecust(const TripId& i) {
+  return ctx().customers.at(tidx(i));
+}
+
+/* Base cost of a trip; for vehicles, also the initial route
+ * (taxis have no initial route) */
+static DistInt base_cost(const Trip& trip, vec_t<Wayp>& rte) {
+  if (trip.load() < 0) {
+    NodeId trip_dest = trip.dest();
+    // while (trip_dest == -1 || trip_dest == trip.orig())
+    //   trip_dest = random_node();
+    if (trip_dest == -1)
+      trip_dest = trip.orig();
+    Stop a(trip.id(), trip.orig(), StopType::VehlOrig, trip.early(), trip.late(), trip.early());
+    Stop b(trip.id(), trip_dest  , StopType::VehlDest, trip.early(), trip.late());
+    return route_through({a,b}, rte, false);
+  } else if (trip.load() > 0) {
+    return Cargo::gtree().search(trip.orig(), trip.dest());
+  }
+  return 0;
+}
+
+/* Get the next trip that has appeared by time t, if any */
+bool Cargo::pop_trip(const SimlTime& t, Trip& trip, DistInt& cost,
+                     vec_t<Wayp>& rte) {
+  if (stream_.is_open()) {
+    ErlyTime early;
+    if (!stream_.peek(early) || early > t) return false;
+    stream_.next(trip, cost, rte);
+    if (!stream_.has_costs()) cost = base_cost(trip, rte);
+    return true;
+  }
+  if (next_trip_ == trips_.size() || trips_.at(next_trip_).early() > t)
+    return false;
+  trip = trips_.at(next_trip_);
+  cost = init_costs_.at(next_trip_);
+  rte = std::move(init_rtes_.at(next_trip_));  // no longer needed
+  next_trip_++;
+  return true;
+}
+
+/* Insert the trips that have appeared by t into the database */
+void Cargo::admit() {
+  std::lock_guard<std::mutex> dblock(ctx_.dbmx);
+  Trip trip;
+  DistInt cost;
+  vec_t<Wayp> rte;
+  bool begun = false;
+  while (pop_trip(ctx_.t, trip, cost, rte)) {
+    if (!begun) {
+      sqlite3_exec(ctx_.db, "BEGIN", NULL, NULL, &err);
+      begun = true;
+    }
+    StopType stop_type = StopType::CustOrig;  // default
+
+    /* Insert vehicle (negative load) */
+    if (trip.load() < 0) {
+      /* Sanity check */
+      if (trip.dest() == -1 && trip.late() != -1) {
+        print(MessageType::Error) << "Vehicle " << trip.id() << " has a late window with no destination\n";
+        throw std::runtime_error("bad vehicle");
+      }
+      stop_type = StopType::VehlOrig;
+
+      NodeId trip_dest = (trip.dest() == -1 ? trip.orig() : trip.dest());
+      Stop a(trip.id(), trip.orig(), StopType::VehlOrig, trip.early(), trip.late(), trip.early());
+      Stop b(trip.id(), trip_dest  , StopType::VehlDest, trip.early(), trip.late());
+
+      /* Initialize vehicle schedule */
+      vec_t<Stop> sch;
+      if (trip.late() != -1) {
+        Stop next_loc(trip.id(), rte.at(1).second, StopType::VehlOrig, trip.early(), trip.late());
+        sch.push_back(next_loc);
+        sch.push_back(b);
+      } else {
+        sch.push_back(a);
+        sch.push_back(b);
+      }
+
+      /* Log initial position */
+      Logger::put_r_message(rte, trip.id(), 0);
+
+      /* Insert to database */
+      sqlite3_bind_int(ive_stmt, 1, trip.id());
+      sqlite3_bind_int(ive_stmt, 2, trip.orig());
+      sqlite3_bind_int(ive_stmt, 3, trip.dest());
+      sqlite3_bind_int(ive_stmt, 4, trip.early());
+      sqlite3_bind_int(ive_stmt, 5, trip.late());
+      sqlite3_bind_int(ive_stmt, 6, trip.load());
+      sqlite3_bind_int(ive_stmt, 7, 0);
+      sqlite3_bind_int(ive_stmt, 8, (int)VehlStatus::Enroute);
+      vec_t<RteRun> runs;
+      ctx_.segments.pack(rte, sch, runs);
+      sqlite3_bind_blob(ive_stmt, 9,
+        static_cast<void const*>(runs.data()),runs.size()*sizeof(RteRun),SQLITE_TRANSIENT);
+      sqlite3_bind_int(ive_stmt,10, 0);
+      if (trip.late() != -1)
+        sqlite3_bind_int(ive_stmt,11, rte.at(1).first);
+      else
+        sqlite3_bind_int(ive_stmt,11, 0);
+      sqlite3_bind_blob(ive_stmt,12,
+        static_cast<void const*>(sch.data()),sch.size()*sizeof(Stop),SQLITE_TRANSIENT);
+      if (sqlite3_step(ive_stmt) != SQLITE_DONE) {
+        print(MessageType::Error) << "Failure at vehicle " << trip.id() << "\n";
+        print(MessageType::Error) << "Failed (insert vehicle). Reason:\n";
+        throw std::runtime_error(sqlite3_errmsg(ctx_.db));
+      }
+      sqlite3_clear_bindings(ive_stmt);
+      sqlite3_reset(ive_stmt);
+
+      /* Record base cost (for rs vehicles) */
+      if (trip.dest() == -1) cost = 0;
+      base_cost_ += cost;
+      ctx_.trip_costs[tidx(trip.id())] = cost;
+
+    /* Insert customer (positive load) */
+    } else if (trip.load() > 0) {
+      /* Record base cost, insert to local index */
+      base_cost_ += cost;
+      Customer cust(trip.id(), trip.orig(), trip.dest(), trip.early(),
+                    trip.late(), trip.load(), CustStatus::Waiting);
+      ctx_.trip_costs[tidx(trip.id())] = cost;
+      ctx_.customers[tidx(trip.id())] = cust;
+      ctx_.events.push({CustEventType::Arrive, trip.id(), ctx_.t, cust});
+      set_visited(trip.id(), StopsVisited::None);
+      expire(trip.id(), trip.early());
+      ctx_.nwaiting++;
+      stop_type = StopType::CustOrig;
+
+      /* Insert to database */
+      sqlite3_bind_int(icu_stmt, 1, trip.id());
+      sqlite3_bind_int(icu_stmt, 2, trip.orig());
+      sqlite3_bind_int(icu_stmt, 3, trip.dest());
+      sqlite3_bind_int(icu_stmt, 4, trip.early());
+      sqlite3_bind_int(icu_stmt, 5, trip.late());
+      sqlite3_bind_int(icu_stmt, 6, trip.load());
+      sqlite3_bind_int(icu_stmt, 7, (int)CustStatus::Waiting);
+      sqlite3_bind_null(icu_stmt, 8);
+      if (sqlite3_step(icu_stmt) != SQLITE_DONE) {
+        print(MessageType::Error) << "Failure at customer " << trip.id() << "\n";
+        print(MessageType::Error) << "Failed (insert customer). Reason:\n";
+        throw std::runtime_error(sqlite3_errmsg(ctx_.db));
+      }
+      sqlite3_clear_bindings(icu_stmt);
+      sqlite3_reset(icu_stmt);
+
+    /* Insert small "customers", e.g. mail, packages (zero load) */
+    } else {
+      // placeholder
+      print(MessageType::Warning) << "Trip" << trip.id() << " load == 0\n";
+    }
+
+    /* Insert origin */
+    sqlite3_bind_int(ist_stmt, 1, trip.id());
+    sqlite3_bind_int(ist_stmt, 2, trip.orig());
+    sqlite3_bind_int(ist_stmt, 3, (int)stop_type);
+    sqlite3_bind_int(ist_stmt, 4, trip.early());
+    sqlite3_bind_int(ist_stmt, 5, trip.late());
+    sqlite3_bind_int(ist_stmt, 6, -1);
+    if (sqlite3_step(ist_stmt) != SQLITE_DONE) {
+      print(MessageType::Error) << "Failure at stop " << trip.orig() << "\n";
+      print(MessageType::Error) << "Failed (insert stop). Reason:\n";
+      throw std::runtime_error(sqlite3_errmsg(ctx_.db));
+    }
+    sqlite3_clear_bindings(ist_stmt);
+    sqlite3_reset(ist_stmt);
+
+    /* Insert destination */
+    sqlite3_bind_int(ist_stmt, 1, trip.id());
+    sqlite3_bind_int(ist_stmt, 2, trip.dest());
+    sqlite3_bind_int(ist_stmt, 3, (int)stop_type + 1);
+    sqlite3_bind_int(ist_stmt, 4, trip.early());
+    sqlite3_bind_int(ist_stmt, 5, trip.late());
+    sqlite3_bind_int(ist_stmt, 6, -1);
+    if (sqlite3_step(ist_stmt) != SQLITE_DONE) {
+      print(MessageType::Error) << "Failure at stop " << trip.dest() << "\n";
+      print(MessageType::Error) << "Failed (insert stop). Reason:\n";
+      throw std::runtime_error(sqlite3_errmsg(ctx_.db));
+    }
+    sqlite3_clear_bindings(ist_stmt);
+    sqlite3_reset(ist_stmt);
+  }
+  if (begun) sqlite3_exec(ctx_.db, "END", NULL, NULL, &err);
+}
+
+void Cargo::expire(const CustId& cust_id, const ErlyTime& early) {
+  SimContext& ctx = Cargo::ctx();
+  const SimlTime due = std::max(early + ctx.matp + 1, ctx.t + 1);
+  ctx.wheel.at(due % ctx.wheel.size()).push_back(cust_id);
+}
+
+/* Time out the customers in the current slot that are still unassigned;
+ * the others were matched in time (or have been retired). Call with dbmx
+ * held. */
+void Cargo::expire_due() {
+  vec_t<CustId>& slot = ctx_.wheel.at(ctx_.t % ctx_.wheel.size());
+  for (const CustId& cust_id : slot) {
+    sqlite3_bind_int(tmo_stmt, 1, (int)CustStatus::Canceled);
+    sqlite3_bind_int(tmo_stmt, 2, cust_id);
+    sqlite3_bind_int(tmo_stmt, 3, (int)CustStatus::Waiting);
+    if (sqlite3_step(tmo_stmt) != SQLITE_DONE) {
+      print(MessageType::Error) << "Failed to timeout customer " << cust_id << ". Reason:\n";
+      throw std::runtime_error(sqlite3_errmsg(ctx_.db));
+    }
+    sqlite3_clear_bindings(tmo_stmt);
+    sqlite3_reset(tmo_stmt);
+    if (sqlite3_changes(ctx_.db) == 1) {
+      log_t_.push_back(cust_id);
+      ctx_.nwaiting--;
+      ntimeouts_++;
+      total_penalty_ += ctx_.trip_costs[tidx(cust_id)];
+    }
+  }
+  slot.clear();
+  DEBUG(1, { print << log_t_.size() << " customers have timed out.\n"; });
+  retire(log_t_, CustStatus::Canceled);
+}
+
+void Cargo::set_visited(const CustId& cust_id, const StopsVisited& v) {
+  ctx_.visited.at(tidx(cust_id)) = v;
+}
+
+/* Move finished customers (status Arrived or Canceled) from the database into
+ * the archive. Call with dbmx held. */
+void Cargo::retire(const vec_t<CustId>& custs, CustStatus status) {
+  for (const CustId& cust_id : custs) {
+    /* Skip the customer if its status changed in the meantime
+     * (e.g. it was matched just before it would have timed out) */
+    sqlite3_bind_int(dcu_stmt, 1, cust_id);
+    sqlite3_bind_int(dcu_stmt, 2, (int)status);
+    if (sqlite3_step(dcu_stmt) != SQLITE_DONE) {
+      print(MessageType::Error) << "Failed (retire customer " << cust_id << "). Reason:\n";
+      throw std::runtime_error(sqlite3_errmsg(ctx_.db));
+    }
+    sqlite3_clear_bindings(dcu_stmt);
+    sqlite3_reset(dcu_stmt);
+    if (sqlite3_changes(ctx_.db) == 0) continue;
+
+    sqlite3_bind_int(dso_stmt, 1, cust_id);
+    if (sqlite3_step(dso_stmt) != SQLITE_DONE) {
+      print(MessageType::Error) << "Failed (retire stops of " << cust_id << "). Reason:\n";
+      throw std::runtime_error(sqlite3_errmsg(ctx_.db));
+    }
+    sqlite3_clear_bindings(dso_stmt);
+    sqlite3_reset(dso_stmt);
+    set_visited(cust_id, StopsVisited::Absent);
+    if (status == CustStatus::Canceled)
+      ctx_.events.push({CustEventType::Timeout, cust_id, ctx_.t, {}});
+
+    /* Dropped-off customers were dropped off just now */
+    const size_t k = tidx(cust_id);
+    SimlTime pickup = -1, dropoff = -1;
+    if (status == CustStatus::Arrived) {
+      pickup = pickup_t_[k];
+      dropoff = ctx_.t;
+    }
+    pickup_t_[k] = -1;
+
+    SimContext::RetiredCust rec = {ctx_.customers[k].early(), pickup, dropoff,
+                       ctx_.trip_costs[k], status == CustStatus::Arrived};
+    ctx_.retired[k] = rec;
+  }
+}
+
+/* Remove arrived vehicles from the database (their route costs are already
+ * counted). A vehicle still referenced by a customer is left in place.
+ * Call with dbmx held. */
+void Cargo::retire(const vec_t<VehlId>& vehls) {
+  for (const VehlId& vehl_id : vehls) {
+    sqlite3_bind_int(dve_stmt, 1, vehl_id);
+    sqlite3_bind_int(dve_stmt, 2, (int)VehlStatus::Arrived);
+    if (sqlite3_step(dve_stmt) != SQLITE_DONE) {
+      print(MessageType::Error) << "Failed (retire vehicle " << vehl_id << "). Reason:\n";
+      throw std::runtime_error(sqlite3_errmsg(ctx_.db));
+    }
+    sqlite3_clear_bindings(dve_stmt);
+    sqlite3_reset(dve_stmt);
+    if (sqlite3_changes(ctx_.db) == 0) continue;
+
+    sqlite3_bind_int(dso_stmt, 1, vehl_id);
+    if (sqlite3_step(dso_stmt) != SQLITE_DONE) {
+      print(MessageType::Error) << "Failed (retire stops of " << vehl_id << "). Reason:\n";
+      throw std::runtime_error(sqlite3_errmsg(ctx_.db));
+    }
+    sqlite3_clear_bindings(dso_stmt);
+    sqlite3_reset(dso_stmt);
+  }
+}
+
 /* "Move" the vehicles by subtracting distance to next node according to
  * route and speed. Handle accordingly if vehicle moves to next node and if
  * next node is a stop of some type. */
@@ -171,6 +585,7 @@ int Cargo::step(int& ndeact) {
   /* Reset counters */
   int nrows = 0;  // number of vehicles moved to new nodes
   ndeact = 0;     // number of vehicles deactivated in this step
+  vec_t<VehlId> deact;  // the deactivated vehicles (to be retired)
 
   /* Prepare logger containers */
   log_v_.clear(); // vehicle positions
@@ -182,26 +597,28 @@ int Cargo::step(int& ndeact) {
   /* Acquire lock:
    * During this time, no other process (e.g. RSAlgorithm::assign) can
    * access the database. */
-  std::lock_guard<std::mutex> dblock(dbmx);
+  std::lock_guard<std::mutex> dblock(ctx_.dbmx);
 
   /* Bulk-update next-node distance (bulk-move the vehicles) */
-  sqlite3_bind_int(mov_stmt, 1, speed_);
-  sqlite3_bind_int(mov_stmt, 2, t_);
+  sqlite3_bind_int(mov_stmt, 1, ctx_.speed);
+  sqlite3_bind_int(mov_stmt, 2, ctx_.t);
   sqlite3_bind_int(mov_stmt, 3, (int)VehlStatus::Arrived);
+  sqlite3_bind_int(mov_stmt, 4, (int)VehlStatus::Parked);
   if (sqlite3_step(mov_stmt) != SQLITE_DONE) {
     print(MessageType::Error) << "mov_stmt failed; reason:" << std::endl;
-    throw std::runtime_error(sqlite3_errmsg(db_));
+    throw std::runtime_error(sqlite3_errmsg(ctx_.db));
   }
   sqlite3_clear_bindings(mov_stmt);
   sqlite3_reset(mov_stmt);
 
   /* Initiate a transaction */
-  sqlite3_exec(db_, "BEGIN", NULL, NULL, &err);
+  sqlite3_exec(ctx_.db, "BEGIN", NULL, NULL, &err);
 
   /* Update move events (pickup, dropoff, etc.)
    * (vehicles where bulk-move resulted in negative nnd) */
-  sqlite3_bind_int(ssv_stmt, 1, t_);
+  sqlite3_bind_int(ssv_stmt, 1, ctx_.t);
   sqlite3_bind_int(ssv_stmt, 2, (int)VehlStatus::Arrived);
+  sqlite3_bind_int(ssv_stmt, 3, (int)VehlStatus::Parked);
   while ((rc = sqlite3_step(ssv_stmt)) == SQLITE_ROW) {  // O(|vehicles|)
     nrows++;
     /* Extract */
@@ -209,16 +626,16 @@ int Cargo::step(int& ndeact) {
     const SimlTime vet = sqlite3_column_int(ssv_stmt,3); // early
     const SimlTime vlt = sqlite3_column_int(ssv_stmt,4); // late
     const Load load    = sqlite3_column_int(ssv_stmt,5); // load
-    const Wayp* rtebuf = static_cast<const Wayp*>(sqlite3_column_blob(ssv_stmt, 8));
     const Stop* schbuf = static_cast<const Stop*>(sqlite3_column_blob(ssv_stmt,11));
-    const vec_t<Wayp> rte(rtebuf,rtebuf+sqlite3_column_bytes(ssv_stmt, 8) / sizeof(Wayp));
+    const PackedRoute rte(ctx_.segments, sqlite3_column_blob(ssv_stmt, 8),
+                          sqlite3_column_bytes(ssv_stmt, 8));  // read lazily
     const vec_t<Stop> sch(schbuf,schbuf+sqlite3_column_bytes(ssv_stmt,11) / sizeof(Stop));
     vec_t<Stop> new_sch = sch;                     // mutable copy
     RteIdx  lvn = sqlite3_column_int(ssv_stmt,9);        // last-visited node
     DistInt nnd = sqlite3_column_int(ssv_stmt,10);       // next-node dist
 
     DEBUG(2, {  // Print vehicle info
-      print << "t=" << t_ << std::endl;
+      print << "t=" << ctx_.t << std::endl;
       print << "Vehicle " << vid << "\n"
             << " early: " << vet << "\n"
             << " late:  " << vlt << "\n"
@@ -226,7 +643,9 @@ int Cargo::step(int& ndeact) {
             << " load:  " << load << "\n"
             << " lvn:   " << lvn << "\n"
             << " sched: "; print_sch(sch);
-      print << " route: "; print_rte(rte); });
+      vec_t<Wayp> raw_rte;
+      rte.unpack(raw_rte);
+      print << " route: "; print_rte(raw_rte); });
 
     bool active = true;  // all vehicles selected by ssv_stmt are active
     int nstops = 0;
@@ -255,48 +674,48 @@ int Cargo::step(int& ndeact) {
         /* Ridesharing vehicle arrives at destination; OR
          * Permanent taxi arrives at destination and no more customers remain */
         if (stop.type() == StopType::VehlDest &&
-           (stop.late() != -1 || t_ > tmin_)) {
+           (stop.late() != -1 || ctx_.t > tmin_)) {
           sqlite3_bind_int(dav_stmt, 1, (int)VehlStatus::Arrived);
           sqlite3_bind_int(dav_stmt, 2, vid);
           if (sqlite3_step(dav_stmt) != SQLITE_DONE) {
             print(MessageType::Error) << "Failed (deactivate vehicle " << vid << "). Reason:\n";
-            throw std::runtime_error(sqlite3_errmsg(db_));
+            throw std::runtime_error(sqlite3_errmsg(ctx_.db));
           } else
             DEBUG(1, { print(MessageType::Info) << "Vehicle " << vid << " arrived." << std::endl; });
           sqlite3_clear_bindings(dav_stmt);
           sqlite3_reset(dav_stmt);
           active = false;  // stops the while loops
           ndeact++;
+          deact.push_back(vid);
+          total_traveled_ += rte.cost();
           /* Log arrival */
           log_a_.push_back(vid);
 
-        /* Permanent taxi arrived at its "destination"
-         * (wait, do nothing) */
+        /* Permanent taxi arrived at its "destination": park it, with a
+         * zero-length route at the node, until an assignment unparks it
+         * (RSAlgorithm) or all customers have appeared (below). Parked
+         * vehicles are skipped by mov_stmt and ssv_stmt, so the route and
+         * schedule are written once rather than every idle tick. */
         } else if (stop.type() == StopType::VehlDest && stop.late() == -1) {
-          // std::cout << "taxi " << vid << " arrived at destination." << std::endl;
-          // while (new_dest == stop.loc())
-          //   new_dest = random_node();  // random destination
           Stop a(vid, stop.loc(), StopType::VehlOrig, stop.early(), -1);
           Stop b(vid, stop.loc(), StopType::VehlDest, stop.early(), -1);
           vec_t<Stop> sch{a, b};
-          vec_t<Wayp> new_rte;
-          route_through(sch, new_rte, false);
-          // int new_nnd = new_rte.at(1).first;
-          int new_nnd = 0;
-          /* Add traveled distance to the waypoints in the new route */
-          for (auto& wp : new_rte)
-            wp.first += rte.back().first;
+          /* Same as route_through(sch, ...), without the shortest-path call */
+          const Wayp wp = std::make_pair(rte.cost(), stop.loc());
+          vec_t<Wayp> new_rte{wp, wp};
+          vec_t<RteRun> runs;
+          ctx_.segments.pack(new_rte, sch, runs);
 
           /* Insert the new route */
           sqlite3_bind_blob(uro_stmt, 1,
-            static_cast<void const*>(new_rte.data()),new_rte.size()*sizeof(Wayp),SQLITE_TRANSIENT);
-          sqlite3_bind_int(uro_stmt, 2, 0);        // lvn
-          sqlite3_bind_int(uro_stmt, 3, new_nnd);  // nnd
+            static_cast<void const*>(runs.data()),runs.size()*sizeof(RteRun),SQLITE_TRANSIENT);
+          sqlite3_bind_int(uro_stmt, 2, 0);  // lvn
+          sqlite3_bind_int(uro_stmt, 3, 0);  // nnd
           sqlite3_bind_int(uro_stmt, 4, vid);
           if (sqlite3_step(uro_stmt) != SQLITE_DONE) {
             print(MessageType::Error) << "Failure at route " << vid << "\n";
             print(MessageType::Error) << "Failed (insert route). Reason:\n";
-            throw std::runtime_error(sqlite3_errmsg(db_));
+            throw std::runtime_error(sqlite3_errmsg(ctx_.db));
           }
           sqlite3_clear_bindings(uro_stmt);
           sqlite3_reset(uro_stmt);
@@ -308,11 +727,22 @@ int Cargo::step(int& ndeact) {
           if (sqlite3_step(sch_stmt) != SQLITE_DONE) {
             print(MessageType::Error) << "Failure at schedule " << vid << "\n";
             print(MessageType::Error) << "Failed (insert schedule). Reason:\n";
-            throw std::runtime_error(sqlite3_errmsg(db_));
+            throw std::runtime_error(sqlite3_errmsg(ctx_.db));
           }
           sqlite3_clear_bindings(sch_stmt);
           sqlite3_reset(sch_stmt);
 
+          /* Park */
+          sqlite3_bind_int(dav_stmt, 1, (int)VehlStatus::Parked);
+          sqlite3_bind_int(dav_stmt, 2, vid);
+          if (sqlite3_step(dav_stmt) != SQLITE_DONE) {
+            print(MessageType::Error) << "Failed (park taxi " << vid << "). Reason:\n";
+            throw std::runtime_error(sqlite3_errmsg(ctx_.db));
+          } else
+            DEBUG(1, { print(MessageType::Info) << "Taxi " << vid << " parked." << std::endl; });
+          sqlite3_clear_bindings(dav_stmt);
+          sqlite3_reset(dav_stmt);
+
           active = false; // stop the loop
           nrows--;  // don't count this as a stepped vehicle
 
@@ -324,9 +754,14 @@ int Cargo::step(int& ndeact) {
           if (sqlite3_step(pup_stmt) != SQLITE_DONE ||
               sqlite3_step(ucs_stmt) != SQLITE_DONE) {
             print(MessageType::Error) << "Failed (veh" << vid << " pickup " << stop.owner() << "). Reason:\n";
-            throw std::runtime_error(sqlite3_errmsg(db_));
+            throw std::runtime_error(sqlite3_errmsg(ctx_.db));
           } else {
-            /* Log pickup */
+            /* Record pickup delay, log pickup */
+            pickup_t_[tidx(stop.owner())] = ctx_.t;
+            set_visited(stop.owner(), StopsVisited::Orig);
+            sum_pickup_delay_ += (ctx_.t - stop.early());
+            npickups_++;
+            ctx_.events.push({CustEventType::Pickup, stop.owner(), ctx_.t, {}});
             log_p_.push_back(stop.owner());
             log_l_.push_back(vid);
             DEBUG(1, { print(MessageType::Info)
@@ -346,9 +781,16 @@ int Cargo::step(int& ndeact) {
           if (sqlite3_step(drp_stmt) != SQLITE_DONE ||
               sqlite3_step(ucs_stmt) != SQLITE_DONE) {
             print(MessageType::Error) << "Failed (veh" << vid << " dropoff " << stop.owner() << "). Reason:\n";
-            throw std::runtime_error(sqlite3_errmsg(db_));
+            throw std::runtime_error(sqlite3_errmsg(ctx_.db));
           } else {
-            /* Log dropoff */
+            /* Record trip delay, log dropoff */
+            const size_t k = tidx(stop.owner());
+            int delay = (ctx_.t - pickup_t_[k]) - (ctx_.trip_costs[k]/original_speed_);
+            if (delay == -1) delay = 0;  // hack to account for rounding error
+            sum_trip_delay_ += delay;
+            ndropoffs_++;
+            set_visited(stop.owner(), StopsVisited::Both);
+            ctx_.events.push({CustEventType::Dropoff, stop.owner(), ctx_.t, {}});
             log_d_.push_back(stop.owner());
             log_l_.push_back(-vid);
             DEBUG(1, { print(MessageType::Info)
@@ -362,33 +804,39 @@ int Cargo::step(int& ndeact) {
 
           /* If vehicle is a taxi, this is its last destination, and there
            * are no more customers, stop the taxi (nstops is already incremented) */
-          if (vlt == -1 && t_ > tmin_ &&
+          if (vlt == -1 && ctx_.t > tmin_ &&
               sch.at(1+nstops).type() == StopType::VehlDest) {
             sqlite3_bind_int(dav_stmt, 1, (int)VehlStatus::Arrived);
             sqlite3_bind_int(dav_stmt, 2, vid);
             if (sqlite3_step(dav_stmt) != SQLITE_DONE) {
               print(MessageType::Error) << "Failed (deactivate taxi " << vid << "). Reason:\n";
-              throw std::runtime_error(sqlite3_errmsg(db_));
+              throw std::runtime_error(sqlite3_errmsg(ctx_.db));
             } else
               DEBUG(1, { print(MessageType::Info) << "Taxi " << vid << " deactivated." << std::endl; });
             sqlite3_clear_bindings(dav_stmt);
             sqlite3_reset(dav_stmt);
             active = false;  // <-- stops the while loops
             ndeact++;
+            deact.push_back(vid);
+            total_traveled_ += rte.cost();
             /* Log arrival */
             log_a_.push_back(vid);
 
             /* Kill the rest of its route (for computing solution cost) */
-            vec_t<Wayp> new_rte(rte.begin(),rte.begin()+lvn);  // truncate
+            vec_t<Wayp> new_rte;
+            rte.unpack(new_rte);
+            new_rte.resize(lvn);  // truncate
+            vec_t<RteRun> runs;
+            ctx_.segments.pack(new_rte, {}, runs);
             sqlite3_bind_blob(uro_stmt, 1,
-              static_cast<void const*>(new_rte.data()),new_rte.size()*sizeof(Wayp),SQLITE_TRANSIENT);
+              static_cast<void const*>(runs.data()),runs.size()*sizeof(RteRun),SQLITE_TRANSIENT);
             sqlite3_bind_int(uro_stmt, 2, lvn); // lvn
             sqlite3_bind_int(uro_stmt, 3, 0);   // nnd
             sqlite3_bind_int(uro_stmt, 4, stop.owner());
             if (sqlite3_step(uro_stmt) != SQLITE_DONE) {
               print(MessageType::Error) << "Failure at route " << stop.owner() << "\n";
               print(MessageType::Error) << "Failed (insert route). Reason:\n";
-              throw std::runtime_error(sqlite3_errmsg(db_));
+              throw std::runtime_error(sqlite3_errmsg(ctx_.db));
             }
             sqlite3_clear_bindings(uro_stmt);
             sqlite3_reset(uro_stmt);
@@ -396,12 +844,12 @@ int Cargo::step(int& ndeact) {
         }
 
         /* Update visitedAt (used for avg. delay statistics) */
-        sqlite3_bind_int(vis_stmt, 1, t_);
+        sqlite3_bind_int(vis_stmt, 1, ctx_.t);
         sqlite3_bind_int(vis_stmt, 2, stop.owner());
         sqlite3_bind_int(vis_stmt, 3, stop.loc());
         if (sqlite3_step(vis_stmt) != SQLITE_DONE) {
           print(MessageType::Error) << "Failed (update visitedAt for stop " << stop.owner() << " at " << stop.loc() << "). Reason:\n";
-          throw std::runtime_error(sqlite3_errmsg(db_));
+          throw std::runtime_error(sqlite3_errmsg(ctx_.db));
         }
         sqlite3_clear_bindings(vis_stmt);
         sqlite3_reset(vis_stmt);
@@ -414,10 +862,12 @@ int Cargo::step(int& ndeact) {
        * doesn't get deactivated; then it runs out of route, and the access
        * fails. In case of this, catch and print the vehicle's info. */
       if (active && lvn+1 == rte.size()) {
-        print << "t=" << t_ << std::endl;
+        print << "t=" << ctx_.t << std::endl;
         print << "Vehicle " << vid << "\n\tearly:\t" << vet << "\n\tlate:\t" << vlt << "\n\tnnd:\t" << nnd << "\n\tlvn:\t" << lvn << "\n";
         print << "\tsched:"; print_sch(sch);
-        print << "\troute:"; print_rte(rte);
+        vec_t<Wayp> raw_rte;
+        rte.unpack(raw_rte);
+        print << "\troute:"; print_rte(raw_rte);
         throw;
       }
 
@@ -432,7 +882,7 @@ int Cargo::step(int& ndeact) {
        * Remove the just-visited stops, and set the first stop in the schedule
        * to be the next node. */
       if (nstops > 0) new_sch.erase(new_sch.begin()+1, new_sch.begin()+1+nstops);
-      new_sch[0] = Stop(vid, rte.at(lvn+1).second, StopType::VehlOrig, vet, vlt, t_);
+      new_sch[0] = Stop(vid, rte.at(lvn+1).second, StopType::VehlOrig, vet, vlt, ctx_.t);
       // print_sch(new_sch);
 
       /* Commit the schedule, lvn, and nnd after motion */
@@ -443,36 +893,77 @@ int Cargo::step(int& ndeact) {
       sqlite3_bind_int(usc_stmt, 4, vid);
       if (sqlite3_step(usc_stmt) != SQLITE_DONE) {
         print(MessageType::Error) << "Failed (update schedule for vehicle " << vid << "). Reason:\n";
-        throw std::runtime_error(sqlite3_errmsg(db_));
+        throw std::runtime_error(sqlite3_errmsg(ctx_.db));
       }
       sqlite3_clear_bindings(usc_stmt);
       sqlite3_reset(usc_stmt);
 
       /* Kill permanent taxis after all customers have appeared and
        * taxi has no more dropoffs to make */
-      if (vlt == -1 && new_sch.size() == 2 && t_ > tmin_) {
+      if (vlt == -1 && new_sch.size() == 2 && ctx_.t > tmin_) {
         sqlite3_bind_int(dav_stmt, 1, (int)VehlStatus::Arrived);
         sqlite3_bind_int(dav_stmt, 2, vid);
         if (sqlite3_step(dav_stmt) != SQLITE_DONE) {
           print(MessageType::Error) << "Failed (deactivate vehicle " << vid << "). Reason:\n";
-          throw std::runtime_error(sqlite3_errmsg(db_));
+          throw std::runtime_error(sqlite3_errmsg(ctx_.db));
         } else
           DEBUG(1, { print(MessageType::Info) << "Vehicle " << vid << " arrived." << std::endl; });
         sqlite3_clear_bindings(dav_stmt);
         sqlite3_reset(dav_stmt);
         ndeact++;
+        deact.push_back(vid);
+        total_traveled_ += rte.cost();
       }
     }  // end active
   } // end SQLITE_ROW
   if (rc != SQLITE_DONE) {
     print(MessageType::Error) << "Failure in select step vehicles. Reason:\n";
-    throw std::runtime_error(sqlite3_errmsg(db_));
+    throw std::runtime_error(sqlite3_errmsg(ctx_.db));
   }
   sqlite3_clear_bindings(ssv_stmt);
   sqlite3_reset(ssv_stmt);
 
+  /* All customers have appeared: deactivate the parked taxis (once; taxis
+   * arriving from now on are deactivated above instead of parked) */
+  if (parking_ && ctx_.t > tmin_) {
+    vec_t<VehlId> parked;
+    sqlite3_bind_int(spv_stmt, 1, (int)VehlStatus::Parked);
+    while ((rc = sqlite3_step(spv_stmt)) == SQLITE_ROW) {
+      const VehlId vid   = sqlite3_column_int(spv_stmt, 0);
+      const PackedRoute rte(ctx_.segments, sqlite3_column_blob(spv_stmt, 1),
+                            sqlite3_column_bytes(spv_stmt, 1));
+      total_traveled_ += rte.cost();
+      parked.push_back(vid);
+    }
+    if (rc != SQLITE_DONE) {
+      print(MessageType::Error) << "Failure in select parked vehicles. Reason:\n";
+      throw std::runtime_error(sqlite3_errmsg(ctx_.db));
+    }
+    sqlite3_clear_bindings(spv_stmt);
+    sqlite3_reset(spv_stmt);
+    for (const VehlId& vid : parked) {
+      sqlite3_bind_int(dav_stmt, 1, (int)VehlStatus::Arrived);
+      sqlite3_bind_int(dav_stmt, 2, vid);
+      if (sqlite3_step(dav_stmt) != SQLITE_DONE) {
+        print(MessageType::Error) << "Failed (deactivate taxi " << vid << "). Reason:\n";
+        throw std::runtime_error(sqlite3_errmsg(ctx_.db));
+      } else
+        DEBUG(1, { print(MessageType::Info) << "Taxi " << vid << " deactivated." << std::endl; });
+      sqlite3_clear_bindings(dav_stmt);
+      sqlite3_reset(dav_stmt);
+      ndeact++;
+      deact.push_back(vid);
+      log_a_.push_back(vid);
+    }
+    parking_ = false;
+  }
+
+  /* Retire the finished trips (customers first; they refer to vehicles) */
+  retire(log_d_, CustStatus::Arrived);
+  retire(deact);
+
   /* Commit the transaction */
-  sqlite3_exec(db_, "END", NULL, NULL, &err);
+  sqlite3_exec(ctx_.db, "END", NULL, NULL, &err);
 
   /* Record events */
   if (!log_p_.empty()) Logger::put_p_message(log_p_);
@@ -484,153 +975,462 @@ int Cargo::step(int& ndeact) {
   return nrows;  // return number of stepped vehicles
 }   // dblock exits scope and is released
 
-/* Returns cost of all vehicle routes, plus the base cost for each
- * unassigned customer trip */
+/* The route costs and the timed-out customers are counted as they happen;
+ * add the base cost of each customer still unassigned at the end (few,
+ * since finished customers are retired) */
 void Cargo::total_solution_cost() {
-  this->total_traveled_ = 0;
-  this->total_penalty_  = 0;
-
-  /* Get all vehicle route costs */
-  while ((rc = sqlite3_step(sar_stmt)) == SQLITE_ROW) {
-    const Wayp* rtebuf = static_cast<const Wayp*>(sqlite3_column_blob(sar_stmt, 0));
-    const vec_t<Wayp> route(rtebuf, rtebuf + sqlite3_column_bytes(sar_stmt, 0) / sizeof(Wayp));
-    this->total_traveled_ += route.back().first;
-  }
-  if (rc != SQLITE_DONE) {
-    print(MessageType::Error) << "Failure in select all routes. Reason:\n";
-    throw std::runtime_error(sqlite3_errmsg(db_));
-  }
-  sqlite3_reset(sar_stmt);
-
-  /* Get cost of unassigned customers */
   while ((rc = sqlite3_step(sac_stmt)) == SQLITE_ROW) {
     const CustId cust_id = sqlite3_column_int(sac_stmt, 0);
     const VehlId assigned_to = sqlite3_column_int(sac_stmt, 7);
     if (assigned_to == 0) {
-      this->total_penalty_ += trip_costs_.at(cust_id);
+      this->total_penalty_ += ctx_.trip_costs[tidx(cust_id)];
     }
   }
+  if (rc != SQLITE_DONE) {
+    print(MessageType::Error) << "Failure in select all customers. Reason:\n";
+    throw std::runtime_error(sqlite3_errmsg(ctx_.db));
+  }
+  sqlite3_reset(sac_stmt);
 }
 
 SimlDur Cargo::avg_pickup_delay() {
-  /* Get all origin stops belonging to assigned customers
-   * to find (visitedAt - early) */
-  SimlDur pdelay = 0;
-  int count = 0;
-  std::string querystr = "select * from stops where type = "
-      + std::to_string((int)StopType::CustOrig) + " and "
-      + "exists (select id from customers "
-      + "where customers.id = stops.owner and customers.assignedTo not null);";
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(db_, querystr.c_str(), -1, &stmt, NULL);
-  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-    //const CustId owner = sqlite3_column_int(stmt, 0);
-    const SimlTime early = sqlite3_column_int(stmt, 3);
-    const SimlTime visitedAt = sqlite3_column_int(stmt, 5);
-    pdelay += (visitedAt - early);
-    //print << "Cust " << owner << " picked up at: " << visitedAt << "; early: " << early << "; delay: " << visitedAt - early << std::endl;
-    count++;
+  return npickups_ == 0 ? -1 : sum_pickup_delay_/(long int)npickups_; // int
+}
+
+SimlDur Cargo::avg_trip_delay() {
+  return ndropoffs_ == 0 ? -1 : sum_trip_delay_/(long int)ndropoffs_; // int
+}
+
+/* Snapshot of the metrics so far (arrived vehicles only for traveled) */
+void Cargo::put_metrics(std::ofstream& f_met, const RSAlgorithm& rsalg) {
+  f_met << ctx_.t
+        << ' ' << total_traveled_
+        << ' ' << total_penalty_
+        << ' ' << rsalg.matches()
+        << ' ' << npickups_
+        << ' ' << ndropoffs_
+        << ' ' << ntimeouts_
+        << ' ' << ctx_.nwaiting
+        << ' ' << avg_pickup_delay()
+        << ' ' << avg_trip_delay()
+        << std::endl;
+}
+
+NodeId Cargo::random_node() {
+  std::uniform_int_distribution<> dis(0, graph().size()-1);
+  NodeId res = -1;
+  do res = graph().id.at(dis(rng));
+  while (res == -1);
+  return res;
+}
+
+/* Start Cargo with the default (blank) RSAlgorithm */
+void Cargo::start() {
+  bind();  // the algorithm works on the simulation bound when it is made
+  RSAlgorithm _;
+  start(_);
+}
+
+/* Begin (or resume) the simulation */
+void Cargo::start(RSAlgorithm& rsalg) { run(rsalg, -1); }
+
+/* What-if branching. The algorithm and logger threads are stopped before
+ * the fork (only the calling thread survives a fork), so the children start
+ * from a quiet state: nothing locked, nothing queued. */
+int Cargo::start(RSAlgorithm& rsalg, const SimlTime& t, const int& n) {
+  if (run(rsalg, t)) return 0;  // finished by t
+  print << "Forking " << n << " branches at t=" << ctx_.t << std::endl;
+  std::cout.flush();
+  vec_t<pid_t> pids;
+  for (int k = 1; k <= n; ++k) {
+    const pid_t pid = fork();
+    if (pid < 0) {
+      print(MessageType::Error) << "Failed (fork branch " << k << ")\n";
+      break;
+    }
+    if (pid == 0) {
+      reseed_events();
+      return k;
+    }
+    pids.push_back(pid);
   }
-  if (rc != SQLITE_DONE) {
-    print(MessageType::Error) << "Failure in avg_pickup_delay(). Reason:\n";
-    throw std::runtime_error(sqlite3_errmsg(db_));
+  int failed = n - (int)pids.size();
+  for (const pid_t& pid : pids) {
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)
+     || WEXITSTATUS(status) != 0)
+      failed++;
   }
-  sqlite3_reset(stmt);
-  sqlite3_finalize(stmt);
-
-  return count == 0 ? -1 : pdelay/count; // int
+  if (failed > 0)
+    print(MessageType::Warning) << failed << " of " << n << " branches failed\n";
+  else
+    print << "Finished " << n << " branches" << std::endl;
+  reseed_events();  // the parent may continue too
+  return 0;
 }
 
-SimlDur Cargo::avg_trip_delay() {
-  /* Get all orig, dest stops belonging to assigned customers
-   * to find (dest.visitedAt - orig.visitedAt - base cost) */
-  SimlDur tdelay = 0;
-  dict<CustId, SimlTime> orig_t;
-  dict<CustId, SimlTime> dest_t;
-  vec_t<CustId> keys;
-  std::string querystr = "select * from stops where type = "
-      + std::to_string((int)StopType::CustOrig) + " and " // <-- origs
-      + "exists (select id from customers "
-      + "where customers.id = stops.owner and customers.assignedTo not null);";
-  sqlite3_stmt* stmt1;
-  sqlite3_prepare_v2(db_, querystr.c_str(), -1, &stmt1, NULL);
-  while ((rc = sqlite3_step(stmt1)) == SQLITE_ROW) {
-    const CustId cust_id = sqlite3_column_int(stmt1, 0);
-    const SimlTime visitedAt = sqlite3_column_int(stmt1, 5);
-    orig_t[cust_id] = visitedAt;
-    keys.push_back(cust_id);
+/* A branch continues with a new algorithm, which has not seen the customers
+ * that arrived before the fork; replay them as arrivals */
+void Cargo::reseed_events() {
+  bind();
+  ctx_.events.clear();
+  std::lock_guard<std::mutex> dblock(ctx_.dbmx);
+  while ((rc = sqlite3_step(sac_stmt)) == SQLITE_ROW) {
+    Customer cust(
+        sqlite3_column_int(sac_stmt, 0), sqlite3_column_int(sac_stmt, 1),
+        sqlite3_column_int(sac_stmt, 2), sqlite3_column_int(sac_stmt, 3),
+        sqlite3_column_int(sac_stmt, 4), sqlite3_column_int(sac_stmt, 5),
+        static_cast<CustStatus>(sqlite3_column_int(sac_stmt, 6)),
+        sqlite3_column_int(sac_stmt, 7));
+    if (cust.status() == CustStatus::Waiting)
+      ctx_.events.push({CustEventType::Arrive, cust.id(), ctx_.t, cust});
   }
   if (rc != SQLITE_DONE) {
-    print(MessageType::Error) << "Failure in avg_trip_delay(). Reason:\n";
-    throw std::runtime_error(sqlite3_errmsg(db_));
+    print(MessageType::Error) << "Failure in select all customers. Reason:\n";
+    throw std::runtime_error(sqlite3_errmsg(ctx_.db));
   }
-  sqlite3_reset(stmt1);
-  sqlite3_finalize(stmt1);
-  querystr = "select * from stops where type = "
-      + std::to_string((int)StopType::CustDest) + " and " // <-- dests
-      + "exists (select id from customers "
-      + "where customers.id = stops.owner and customers.assignedTo not null);";
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(db_, querystr.c_str(), -1, &stmt, NULL);
-  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-    const CustId cust_id = sqlite3_column_int(stmt, 0);
-    const SimlTime visitedAt = sqlite3_column_int(stmt, 5);
-    dest_t[cust_id] = visitedAt;
+  sqlite3_reset(sac_stmt);
+}
+
+/* Shortest-paths cache ------------------------------------------------------*/
+/* Least recently used first, so that putting them back in order keeps their
+ * recency */
+void Cargo::put_spcache(std::ostream& os, const size_t& n) {
+  std::lock_guard<std::mutex> splock(ctx_.spmx);
+  vec_t<const vec_t<NodeId>*> paths;
+  for (const auto& kv : ctx_.spcache) {     // most recently used first
+    if (paths.size() == n) break;
+    paths.push_back(&kv.second);
   }
-  if (rc != SQLITE_DONE) {
-    print(MessageType::Error) << "Failure in avg_trip_delay(). Reason:\n";
-    throw std::runtime_error(sqlite3_errmsg(db_));
+  bin_put(os, (uint64_t)paths.size());
+  for (auto it = paths.rbegin(); it != paths.rend(); ++it)
+    bin_put(os, **it);
+}
+
+void Cargo::get_spcache(std::istream& is) {
+  std::lock_guard<std::mutex> splock(ctx_.spmx);
+  uint64_t n;
+  vec_t<NodeId> path;
+  for (bin_get(is, n); n > 0; --n) {
+    bin_get(is, path);
+    if (path.empty()) throw std::runtime_error("empty shortest path");
+    ctx_.spcache.put(std::to_string(path.front())+"|"+std::to_string(path.back()), path);
   }
-  sqlite3_reset(stmt);
-  sqlite3_finalize(stmt);
+}
 
-  for (const CustId& cust_id : keys) {
-    int delay = (dest_t.at(cust_id) - orig_t.at(cust_id)) - (trip_costs_.at(cust_id)/original_speed_);
-    if (delay == -1) delay = 0;  // hack to account for rounding error
-    //std::cout << "Cust " << cust_id << " arrived at o: " << orig_t.at(cust_id)
-    //          << "; d: " << dest_t.at(cust_id)
-    //          << "; base: " << trip_costs_.at(cust_id)
-    //          << "; speed: " << original_speed_
-    //          << "; delay: " << delay << std::endl;
-    tdelay += delay;
+/* The paths between the busiest trip ends (stations, airports) are asked for
+ * over and over; compute them all up front, in parallel */
+void Cargo::warm_spcache(const Filepath& path_to_problem, const size_t& k) {
+  dict<NodeId, size_t> freq;
+  auto count = [&freq](const Trip& trip) {
+    if (trip.load() <= 0) return;  // customers only
+    freq[trip.orig()]++;
+    freq[trip.dest()]++;
+  };
+  if (stream_.is_open()) {  // read the trips again, without disturbing stream_
+    ProblemStream scan;
+    ProblemSet probset;
+    Trip trip;
+    DistInt cost;
+    vec_t<Wayp> rte;
+    scan.open(path_to_problem, roadhash(), probset);
+    while (scan.next(trip, cost, rte)) count(trip);
+  } else {
+    for (const Trip& trip : trips_) count(trip);
   }
+  vec_t<std::pair<NodeId, size_t>> ends(freq.begin(), freq.end());
+  std::sort(ends.begin(), ends.end(), [](const std::pair<NodeId, size_t>& a,
+                                         const std::pair<NodeId, size_t>& b) {
+    return a.second > b.second || (a.second == b.second && a.first < b.first); });
+  /* The n(n-1) paths must fit in the cache, or the last ones computed
+   * evict the first */
+  size_t kmax = 1;
+  while ((kmax+1)*kmax <= (size_t)LRU_SP_CACHE_SIZE) kmax++;
+  if (k > kmax)
+    print(MessageType::Warning) << "Warm-up of " << k << " trip ends exceeds the cache (" << LRU_SP_CACHE_SIZE << " paths); using " << kmax << "\n";
+  if (ends.size() > std::min(k, kmax)) ends.resize(std::min(k, kmax));
+  const size_t n = ends.size(), npaths = (n < 2 ? 0 : n*(n-1));
+
+  std::atomic<size_t> next_path(0);
+  auto warm = [&]() {
+    bind();
+    vec_t<Wayp> path;
+    for (size_t i = next_path++; i < npaths; i = next_path++) {
+      const size_t a = i / (n-1), b = i % (n-1);
+      const NodeId& u = ends[a].first;
+      const NodeId& v = ends[b < a ? b : b+1].first;
+      try { get_shortest_path(u, v, path, gtree(), false); }
+      catch (const std::runtime_error &) {}  // the run will report it if needed
+    }
+  };
+  vec_t<std::thread> workers;
+  for (unsigned w = 1; w < std::thread::hardware_concurrency(); ++w)
+    workers.emplace_back(warm);
+  warm();
+  for (std::thread& worker : workers) worker.join();
+  print << "\tWarmed up " << npaths << " paths between " << n << " trip ends" << std::endl;
+}
 
-  return keys.size() == 0 ? -1 : tdelay/keys.size(); // int
+/* Segments ------------------------------------------------------------------*/
+void Cargo::reclaim_segments() {
+  vec_t<VehlId> ids;
+  vec_t<vec_t<RteRun>> routes;
+  rc = get_routes(ctx_.db, ids, routes);
+  if (rc == SQLITE_OK) {
+    ctx_.segments.reclaim(routes);
+    rc = put_routes(ctx_.db, ids, routes);
+  }
+  if (rc != SQLITE_OK) {
+    print(MessageType::Error) << "Failed (reclaim segments). Reason:\n";
+    throw std::runtime_error(sqlite3_errstr(rc));
+  }
+  segments_live_ = ctx_.segments.size();
 }
 
-NodeId Cargo::random_node() {
-  int bucket, bucket_size;
-  do {
-    std::uniform_int_distribution<> dis1(0,nodes_.bucket_count()-1);
-    bucket = dis1(rng);
-  } while ((bucket_size = nodes_.bucket_size(bucket)) == 0);
+/* Checkpoints ---------------------------------------------------------------*/
+/* Both files are written beside the previous checkpoint and then renamed
+ * over it, so a crash while writing leaves the previous one whole. A crash
+ * between the two renames leaves a new database with the old state file;
+ * both carry the same nonce, so restore() rejects such a pair. */
+void Cargo::checkpoint(const Filepath& path, RSAlgorithm& rsalg) {
+  bind();
+  std::random_device rd;
+  const int64_t nonce = (int64_t)(((uint64_t)rd() << 32) | rd());
+  const Filepath db_path = path + ".db";
+  std::remove((db_path + ".tmp").c_str());
+  sqlite3* p_file;
+  rc = sqlite3_open((db_path + ".tmp").c_str(), &p_file);
+  if (rc == SQLITE_OK) rc = copy_db(p_file, ctx_.db);
+  if (rc == SQLITE_OK) {
+    const std::string stamp = "create table checkpoint(t int, nonce int);"
+      "insert into checkpoint values(" + std::to_string(ctx_.t) + ","
+      + std::to_string(nonce) + ");";
+    rc = sqlite3_exec(p_file, stamp.c_str(), NULL, NULL, NULL);
+  }
+  sqlite3_close(p_file);
+  if (rc != SQLITE_OK) {
+    print(MessageType::Error) << "Failed (checkpoint database). Reason:\n";
+    throw std::runtime_error(sqlite3_errstr(rc));
+  }
 
-  std::uniform_int_distribution<> dis2(0,bucket_size-1);
-  NodeId res = -1;
-  do res = std::next(nodes_.begin(bucket), dis2(rng))->first;
-  while (res == -1);
-  return res;
+  std::ofstream ofs(path + ".tmp", std::ios::binary | std::ios::trunc);
+  if (!ofs.good()) throw std::runtime_error("checkpoint path not writable");
+  ofs.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+  bin_put(ofs, (uint64_t)roadhash());
+  bin_put(ofs, name());
+  bin_put(ofs, ctx_.t);
+  bin_put(ofs, nonce);
+  bin_put(ofs, (uint64_t)(stream_.is_open() ? stream_.nread() : next_trip_));
+
+  /* Simulation context */
+  bin_put(ofs, ctx_.count_sp);
+  bin_put(ofs, ctx_.nwaiting);
+  bin_put(ofs, ctx_.trips.base);
+  bin_put(ofs, ctx_.trip_costs);
+  bin_put(ofs, ctx_.customers);
+  bin_put(ofs, ctx_.retired);
+  bin_put(ofs, ctx_.visited);
+  bin_put(ofs, (uint64_t)ctx_.wheel.size());
+  for (const vec_t<CustId>& slot : ctx_.wheel)
+    bin_put(ofs, slot);
+  bin_put(ofs, (uint64_t)ctx_.segments.size());
+  for (size_t i = 0; i < ctx_.segments.size(); ++i)
+    bin_put(ofs, ctx_.segments.segment(i));
+
+  /* Progress and metrics */
+  bin_put(ofs, tmin_);
+  bin_put(ofs, tmax_);
+  bin_put(ofs, parking_);
+  bin_put(ofs, (uint64_t)active_vehicles_);
+  bin_put(ofs, (uint64_t)base_cost_);
+  bin_put(ofs, total_traveled_);
+  bin_put(ofs, total_penalty_);
+  bin_put(ofs, sum_pickup_delay_);
+  bin_put(ofs, sum_trip_delay_);
+  bin_put(ofs, (uint64_t)npickups_);
+  bin_put(ofs, (uint64_t)ndropoffs_);
+  bin_put(ofs, (uint64_t)ntimeouts_);
+  bin_put(ofs, pickup_t_);
+  std::ostringstream rng_state;
+  rng_state << rng;
+  bin_put(ofs, rng_state.str());
+
+  /* Algorithm */
+  int nmat, nrej;
+  vec_t<SimlTime> delays;
+  rsalg.get_state(nmat, nrej, delays);
+  bin_put(ofs, nmat);
+  bin_put(ofs, nrej);
+  bin_put(ofs, delays);
+
+  /* Shortest paths */
+  put_spcache(ofs, checkpoint_spcache_ ? LRU_SP_CACHE_SIZE : 0);
+  ofs.close();
+  if (!ofs.good()) throw std::runtime_error("checkpoint write failed");
+
+  if (std::rename((db_path + ".tmp").c_str(), db_path.c_str()) != 0
+   || std::rename((path + ".tmp").c_str(), path.c_str()) != 0)
+    throw std::runtime_error("checkpoint rename failed");
 }
 
-/* Start Cargo with the default (blank) RSAlgorithm */
-void Cargo::start() {
-  RSAlgorithm _;
-  start(_);
+void Cargo::restore(const Filepath& path, RSAlgorithm& rsalg) {
+  bind();
+  if (ctx_.t != 0 || resumed_)
+    throw std::runtime_error("restore() called after start()");
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs.good()) throw std::runtime_error("checkpoint not found");
+  print << "Restoring checkpoint (" << path << ")..." << std::endl;
+  char magic[8];
+  uint64_t hash, nadmitted;
+  std::string ckpt_name;
+  SimlTime t;
+  bin_get(ifs, magic);
+  if (!std::equal(magic, magic + 8, CHECKPOINT_MAGIC))
+    throw std::runtime_error("not a checkpoint");
+  bin_get(ifs, hash);
+  bin_get(ifs, ckpt_name);
+  if (hash != roadhash() || ckpt_name != name()) {
+    print(MessageType::Error) << "Checkpoint is of " << ckpt_name << " on another road network\n";
+    throw std::runtime_error("checkpoint of another simulation");
+  }
+  int64_t nonce;
+  bin_get(ifs, t);
+  bin_get(ifs, nonce);
+  bin_get(ifs, nadmitted);
+
+  /* Database (nothing else runs yet, so no need for dbmx), checked to be
+   * the one written with this state */
+  sqlite3* p_file;
+  sqlite3_stmt* stamp = NULL;
+  bool paired = false;
+  rc = sqlite3_open_v2((path + ".db").c_str(), &p_file, SQLITE_OPEN_READONLY, NULL);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_prepare_v2(p_file, "select t, nonce from checkpoint;", -1, &stamp, NULL);
+  if (rc == SQLITE_OK && sqlite3_step(stamp) == SQLITE_ROW)
+    paired = (sqlite3_column_int(stamp, 0) == t
+           && sqlite3_column_int64(stamp, 1) == nonce);
+  sqlite3_finalize(stamp);
+  if (rc == SQLITE_OK && paired) rc = copy_db(ctx_.db, p_file);
+  sqlite3_close(p_file);
+  if (rc != SQLITE_OK) {
+    print(MessageType::Error) << "Failed (restore database). Reason:\n";
+    throw std::runtime_error(sqlite3_errstr(rc));
+  }
+  if (!paired) {
+    print(MessageType::Error) << "Checkpoint database " << path << ".db was not written with " << path << "\n";
+    throw std::runtime_error("checkpoint files do not match");
+  }
+  sqlite3_exec(ctx_.db, "drop table checkpoint;", NULL, NULL, NULL);
+
+  /* Simulation context; the tables must be the ones initialize() made */
+  const size_t nids = ntrips(), nslots = ctx_.wheel.size();
+  uint64_t n;
+  TripId base;
+  bin_get(ifs, ctx_.count_sp);
+  bin_get(ifs, ctx_.nwaiting);
+  bin_get(ifs, base);
+  bin_get(ifs, ctx_.trip_costs);
+  bin_get(ifs, ctx_.customers);
+  bin_get(ifs, ctx_.retired);
+  bin_get(ifs, ctx_.visited);
+  bin_get(ifs, n);
+  if (base != ctx_.trips.base || ctx_.trip_costs.size() != nids || n != nslots) {
+    print(MessageType::Error) << "Checkpoint has " << ctx_.trip_costs.size()
+      << " trips and " << n << " timeout slots (expected " << nids << ", "
+      << nslots << "; same problem and matching period?)\n";
+    throw std::runtime_error("checkpoint does not match");
+  }
+  for (vec_t<CustId>& slot : ctx_.wheel)
+    bin_get(ifs, slot);
+  bin_get(ifs, n);
+  ctx_.segments.clear();
+  for (vec_t<Wayp> seg; n > 0; --n) {
+    bin_get(ifs, seg);
+    ctx_.segments.add(seg);
+  }
+  segments_live_ = ctx_.segments.size();
+
+  /* Progress and metrics */
+  uint64_t active, base_cost, npickups, ndropoffs, ntimeouts;
+  std::string rng_state;
+  bin_get(ifs, tmin_);
+  bin_get(ifs, tmax_);
+  bin_get(ifs, parking_);
+  bin_get(ifs, active);
+  bin_get(ifs, base_cost);
+  bin_get(ifs, total_traveled_);
+  bin_get(ifs, total_penalty_);
+  bin_get(ifs, sum_pickup_delay_);
+  bin_get(ifs, sum_trip_delay_);
+  bin_get(ifs, npickups);
+  bin_get(ifs, ndropoffs);
+  bin_get(ifs, ntimeouts);
+  bin_get(ifs, pickup_t_);
+  bin_get(ifs, rng_state);
+  active_vehicles_ = active;
+  base_cost_ = base_cost;
+  npickups_ = npickups;
+  ndropoffs_ = ndropoffs;
+  ntimeouts_ = ntimeouts;
+  std::istringstream(rng_state) >> rng;
+
+  /* Algorithm */
+  int nmat, nrej;
+  vec_t<SimlTime> delays;
+  bin_get(ifs, nmat);
+  bin_get(ifs, nrej);
+  bin_get(ifs, delays);
+  rsalg.set_state(nmat, nrej, delays);
+
+  /* Shortest paths */
+  get_spcache(ifs);
+
+  /* Skip the trips that were admitted */
+  Trip trip;
+  DistInt cost;
+  vec_t<Wayp> rte;
+  if (stream_.is_open()) {
+    while (stream_.nread() < nadmitted && stream_.next(trip, cost, rte))
+      continue;
+  } else {
+    for (next_trip_ = 0; next_trip_ < nadmitted && next_trip_ < trips_.size(); ++next_trip_)
+      vec_t<Wayp>().swap(init_rtes_.at(next_trip_));
+  }
+
+  ctx_.t = t + 1;
+  resumed_ = true;
+  reseed_events();
+  print(MessageType::Success) << "Restored t=" << t << "; resuming at t=" << ctx_.t << std::endl;
 }
 
-/* Begin the simulation */
-void Cargo::start(RSAlgorithm& rsalg) {
+/* Step the simulation with rsalg until it finishes (returns true) or
+ * reaches tick stop_at unfinished (returns false; tick stop_at is not yet
+ * stepped) */
+bool Cargo::run(RSAlgorithm& rsalg, const SimlTime& stop_at) {
+  bind();  // the calling thread steps the simulation
   print << "Starting Cargo" << std::endl;
   print << "Starting algorithm " << rsalg.name() << std::endl;
 
-  /* Algorithm thread */
-  std::thread thread_rsalg([&rsalg]() { while (!rsalg.done()) {
+  /* Algorithm thread (reads snapshots published by this thread) */
+  rsalg.live_snapshots(true);
+  std::thread thread_rsalg([this, &rsalg]() { bind(); while (!rsalg.done()) {
       if (Cargo::now() > 0) rsalg.listen();
   }});
 
   /* Logger thread */
-  Logger logger(rsalg.name()+".dat");
+  Logger logger(rsalg.name()+".dat", resumed_);
   std::thread logger_thread([&logger]() { logger.run(); });
+  ctx_.logger = &logger;
+
+  /* Metrics snapshots */
+  std::ofstream f_met_;
+  if (metrics_interval_ > 0 && resumed_) {
+    f_met_.open(rsalg.name()+".met", std::ios::app);
+  } else if (metrics_interval_ > 0) {
+    f_met_.open(rsalg.name()+".met", std::ios::out);
+    f_met_ << "t traveled penalty matches pickups dropoffs timeouts waiting"
+           << " avg_pickup_delay avg_trip_delay" << std::endl;
+  }
 
   /* Cargo thread */
   print
@@ -642,57 +1442,55 @@ void Cargo::start(RSAlgorithm& rsalg) {
   print << "-----------------------------------------------------" << std::endl;
   tick_t t0, t1;
   int ndeact, nstepped, dur;
-  while (active_vehicles_ > 0 || t_ <= tmin_) {
-    { std::unique_lock<std::mutex> lock(Cargo::pause_mx);
-      Cargo::pause_cv.wait(lock, []{ return !Cargo::paused(); });
+  auto more = [this]() { return active_vehicles_ > 0 || ctx_.t <= tmin_; };
+  while (more() && ctx_.t != stop_at) {
+    { std::unique_lock<std::mutex> lock(ctx_.pause_mx);
+      ctx_.pause_cv.wait(lock, []{ return !Cargo::paused(); });
 
       t0 = std::chrono::high_resolution_clock::now();
 
-      if (static_mode)
-        ofmx.lock();
+      if (ctx_.static_mode)
+        ctx_.ofmx.lock();
 
-      /* Count waiting customers */
-      sqlite3_bind_int(cwc_stmt, 1, (int)CustStatus::Waiting);
-      sqlite3_bind_int(cwc_stmt, 2, Cargo::now());
-      sqlite3_step(cwc_stmt);
-      int qsize = sqlite3_column_int(cwc_stmt, 0);
-      Logger::put_q_message(qsize);
-      sqlite3_clear_bindings(cwc_stmt);
-      sqlite3_reset(cwc_stmt);
+      /* Insert the trips that appear now */
+      admit();
 
-      /* Log timed-out customers */
+      /* Log the waiting customers, then time out the ones that waited
+       * beyond the matching period (matp) */
       log_t_.clear();
-      sqlite3_bind_int(stc_stmt, 1, t_);
-      sqlite3_bind_int(stc_stmt, 2, matp_);
-      sqlite3_bind_int(stc_stmt, 3, (int)CustStatus::Canceled);
-      while ((rc = sqlite3_step(stc_stmt)) == SQLITE_ROW)
-        log_t_.push_back(sqlite3_column_int(stc_stmt, 0));
-      if (rc != SQLITE_DONE) {
-        print(MessageType::Error) << "Failure in select timeout customers. Reason:\n";
-        throw std::runtime_error(sqlite3_errmsg(db_));
+      { std::lock_guard<std::mutex> dblock(ctx_.dbmx);
+        Logger::put_q_message(ctx_.nwaiting);
+        expire_due();
       }
-      sqlite3_clear_bindings(stc_stmt);
-      sqlite3_reset(stc_stmt);
       if (!log_t_.empty()) Logger::put_t_message(log_t_);
 
-      /* Timeout customers waited beyond the matching period (matp_) */
-      sqlite3_bind_int(tim_stmt, 1, (int)CustStatus::Canceled);
-      sqlite3_bind_int(tim_stmt, 2, t_);
-      sqlite3_bind_int(tim_stmt, 3, matp_);
-      if (sqlite3_step(tim_stmt) != SQLITE_DONE) {
-        print(MessageType::Error) << "Failed to timeout customers. Reason:\n";
-        throw std::runtime_error(sqlite3_errmsg(db_));
-      }
-      DEBUG(1, { print << sqlite3_changes(db_) << " customers have timed out.\n"; });
-      sqlite3_clear_bindings(tim_stmt);
-      sqlite3_reset(tim_stmt);
+      /* Commit the assignments queued by the algorithm since the last step */
+      rsalg.commit_queued();
 
       /* Step the vehicles */
       nstepped = step(ndeact);
       active_vehicles_ -= ndeact;
+      if (metrics_interval_ > 0 && ctx_.t % metrics_interval_ == 0) {
+        std::lock_guard<std::mutex> dblock(ctx_.dbmx);
+        put_metrics(f_met_, rsalg);
+      }
+      if (checkpoint_interval_ > 0 && ctx_.t % checkpoint_interval_ == 0) {
+        std::lock_guard<std::mutex> dblock(ctx_.dbmx);
+        reclaim_segments();  // save only the live ones
+        checkpoint(rsalg.name()+".ckpt", rsalg);
+      } else {
+        std::lock_guard<std::mutex> dblock(ctx_.dbmx);
+        if (ctx_.segments.size() > std::max(2*segments_live_, RECLAIM_MIN_SEGMENTS))
+          reclaim_segments();
+      }
+
+      /* Take a snapshot if the algorithm is waiting for one */
+      { std::lock_guard<std::mutex> dblock(ctx_.dbmx);
+        rsalg.publish_snapshot();
+      }
       print
-        << std::setw(5) << t_ << " ("
-          << std::setw(6) << std::roundf((t_/(float)tmin_*100)*100)/(float)100 << "%)"
+        << std::setw(5) << ctx_.t << " ("
+          << std::setw(6) << std::roundf((ctx_.t/(float)tmin_*100)*100)/(float)100 << "%)"
         << std::setw(8) << nstepped
         << std::setw(7) << active_vehicles_
         << std::setw(8) << rsalg.matches() << " ("
@@ -701,7 +1499,7 @@ void Cargo::start(RSAlgorithm& rsalg) {
 
       t1 = std::chrono::high_resolution_clock::now();
       dur = std::round(dur_milli(t1 - t0).count());
-      if (t_ > tmin_ && full_sim_ == false)
+      if (ctx_.t > tmin_ && full_sim_ == false)
          sleep_interval_ = dur;
       if (dur > sleep_interval_)
         print(MessageType::Warning)
@@ -709,26 +1507,36 @@ void Cargo::start(RSAlgorithm& rsalg) {
       else
         std::this_thread::sleep_for(milli(sleep_interval_ - dur));
 
-      if (static_mode) {
-        ofmx.unlock();
-        if (t_ < tmin_)
+      if (ctx_.static_mode) {
+        ctx_.ofmx.unlock();
+        if (ctx_.t < tmin_)
           std::this_thread::sleep_for(milli(100)); // timing hack
       }
     }
     /* Increment the time step */
-    t_ += 1;
+    ctx_.t += 1;
   }  // end Cargo thread
 
+  const bool finished = !more();  // also if it ends right at stop_at
+
+  rsalg.live_snapshots(false);
   rsalg.kill();
-  rsalg.end();
+  if (finished) rsalg.end();
   thread_rsalg.join();
-  print << "Finished algorithm " << rsalg.name() << std::endl;
+  rsalg.commit_queued();  // resolve the last queued assignments
+  print << (finished ? "Finished" : "Stopped") << " algorithm " << rsalg.name() << std::endl;
 
+  ctx_.logger = nullptr;
   logger.stop();
   logger_thread.join();
   print << "Stopped logger" << std::endl;
+  if (!finished) return false;
 
   total_solution_cost();
+  if (metrics_interval_ > 0) {
+    put_metrics(f_met_, rsalg);  // final
+    f_met_.close();
+  }
 
   std::ofstream f_sol_(rsalg.name()+".sol", std::ios::out);
   f_sol_ << name()         << '\n'
@@ -749,80 +1557,163 @@ void Cargo::start(RSAlgorithm& rsalg) {
          << "Avg. listen            (ms) " << rsalg.avg_listen_dur()          << '\n'
          << "Avg. number cust. per batch " << rsalg.avg_num_cust_per_batch()  << '\n'
          << "Avg. number vehl. per batch " << rsalg.avg_num_vehl_per_batch()  << '\n'
-         << "Count shortest-path comps   " << count_sp_
+         << "Count shortest-path comps   " << ctx_.count_sp
          << std::endl;
   f_sol_.close();
   print << "Finished Cargo" << std::endl;
+  return true;
 }
 
-/* Load road network and problem instance */
-void Cargo::initialize(const Options& opt) {
-  total_customers_ = total_vehicles_ = base_cost_ = 0;
+/* Save the problem with its base costs and initial routes (see file.h).
+ * Must be called before start(); admitted trips give up their routes. */
+void Cargo::compile(const Filepath& path) {
+  bind();
+  if (stream_.is_open())
+    throw std::runtime_error("problem is already compiled");
+  if (next_trip_ > 0)
+    throw std::runtime_error("compile() called after start()");
+  write_compiled(path, roadhash(), probset_, trips_, init_costs_, init_rtes_);
+}
 
-  print << "Starting initialization sequence" << std::endl;
+std::shared_ptr<RoadNetwork> Cargo::load_road(const Filepath& path_to_roadnet) {
+  Message print("cargo");
   std::string path, road;
-  std::tie(path, road) = parse_road_path(opt.path_to_roadnet);
+  std::tie(path, road) = parse_road_path(path_to_roadnet);
 
-  print << "Reading nodes (" << path+road+".rnet" << ")... " << std::endl;
-  const size_t nnodes = read_nodes(path+road+".rnet", nodes_, bbox_);
-  nodes_[-1] = {-1, -1}; // special "no destination" node
-  print << "\tRead " << nnodes << " nodes" << std::endl;
+  std::lock_guard<std::mutex> roadlock(roadmx_);
+  std::shared_ptr<RoadNetwork> net = roads_[path+road].lock();
+  if (net) {
+    print << "Sharing road network (" << path+road << ")" << std::endl;
+    return net;
+  }
+  net = std::make_shared<RoadNetwork>();
+  RoadGraph& G = net->graph;
+
+  const Filepath rgraph = path+road+".rgraph";
+  const size_t stamp = graph_stamp(path+road+".rnet", path+road+".edges");
+  size_t nedges = 0;
+  bool cached = false;
+  try { cached = read_graph(rgraph, stamp, G, net->bbox, nedges); }
+  catch (const std::exception& e) {  // e.g. out of memory on a corrupt id
+    print(MessageType::Warning) << "Could not read " << rgraph << " (" << e.what() << ")\n";
+    G = {};
+  }
+  if (cached) {
+    print << "Reading road graph (" << rgraph << ")... " << std::endl;
+    print << "\tRead " << G.size() << " nodes" << std::endl;
+    print << "\tRead " << nedges << " edges" << std::endl;
+  } else {
+    print << "Reading nodes (" << path+road+".rnet" << ")... " << std::endl;
+    const size_t nnodes = read_nodes(path+road+".rnet", G, net->bbox);
+    print << "\tRead " << nnodes << " nodes" << std::endl;
+
+    print << "Reading edges (" << path+road+".edges" << ")... " << std::endl;
+    nedges = read_edges(path+road+".edges", G);
+    print << "\tRead " << nedges << " edges" << std::endl;
+
+    /* Save the parsed graph so the next run loads it in one read */
+    try { write_graph(rgraph, stamp, G, net->bbox, nedges); }
+    catch (const std::runtime_error& e) {
+      print(MessageType::Warning) << "Could not save " << rgraph << " (" << e.what() << ")\n";
+    }
+  }
+  add_node(G, -1, {-1, -1}); // special "no destination" node
   print << "\tBounding box: "
-        << "(" << bbox().lower_left.lng << "," << bbox().lower_left.lat  << "), "
-        << "(" << bbox().upper_right.lng << ","<< bbox().upper_right.lat << ")";
+        << "(" << net->bbox.lower_left.lng << "," << net->bbox.lower_left.lat  << "), "
+        << "(" << net->bbox.upper_right.lng << ","<< net->bbox.upper_right.lat << ")";
   print << std::endl;
 
-  print << "Reading edges (" << path+road+".edges" << ")... " << std::endl;
-  const size_t nedges = read_edges(path+road+".edges", edges_);
-  print << "\tRead " << nedges << " edges" << std::endl;
-
   print << "Reading gtree (" << path+road+".gtree" << ")... " << std::endl;
   GTree::load(path+road+".gtree");
-  gtree_ = GTree::get();
+  net->gtree = GTree::get();
   print << "\tDone" << std::endl;
 
+  net->hash = graph_hash(G);
+
+  roads_[path+road] = net;
+  return net;
+}
+
+/* Load road network and problem instance */
+void Cargo::initialize(const Options& opt) {
+  total_customers_ = total_vehicles_ = base_cost_ = 0;
+
+  print << "Starting initialization sequence" << std::endl;
+  ctx_.road = load_road(opt.path_to_roadnet);
+
+  /* Shortest paths saved by an earlier run on this network */
+  spcache_file_ = opt.path_to_spcache;
+  spcache_keep_ = opt.spcache_keep;
+  if (spcache_file_ != "") {
+    std::ifstream ifs(spcache_file_, std::ios::binary);
+    char magic[8];
+    uint64_t hash = 0;
+    if (!ifs.good()) {
+      print << "No shortest-paths cache yet (" << spcache_file_ << ")" << std::endl;
+    } else if (!ifs.read(magic, sizeof(magic)) || !ifs.read((char*)&hash, sizeof(hash))
+            || !std::equal(magic, magic + 8, SPCACHE_MAGIC) || hash != roadhash()) {
+      print(MessageType::Warning) << "Shortest-paths cache " << spcache_file_ << " is not of this road network; not loaded\n";
+    } else {
+      print << "Reading shortest-paths cache (" << spcache_file_ << ")... " << std::endl;
+      try {
+        get_spcache(ifs);
+        print << "\tRead " << ctx_.spcache.size() << " paths" << std::endl;
+      } catch (const std::exception& e) {  // truncated or corrupt
+        ctx_.spcache.clear();
+        print(MessageType::Warning) << "Shortest-paths cache " << spcache_file_ << " is unreadable (" << e.what() << "); not loaded\n";
+      }
+    }
+  }
+
   print << "Reading problem (" << opt.path_to_problem << ")... " << std::endl;
-  const size_t ntrips = read_problem(opt.path_to_problem, probset_);
+  size_t ntrips = 0;
+  if (is_compiled(opt.path_to_problem)) {
+    stream_.open(opt.path_to_problem, roadhash(), probset_);
+    ntrips = stream_.size();
+  } else {
+    ntrips = read_problem(opt.path_to_problem, probset_);
+  }
   if (ntrips == 0) {
     print(MessageType::Error) << "Problem file has no trips!\n";
     throw std::runtime_error("bad");
   }
   print << "\tRead " << ntrips << " trips" << std::endl;
   print << "\t" << name() << " on " << road_network() << std::endl;
-  speed_ = parse_speed(opt.path_to_problem);
-  if (speed_ == -1) {
+  ctx_.speed = parse_speed(opt.path_to_problem);
+  if (ctx_.speed == -1) {
     print(MessageType::Error) << "Speed string not found\n";
     throw std::runtime_error("Missing -s in instance name.");
   }
-  print << "\tSpeed set to " << speed_ << " m/s" << std::endl;
+  print << "\tSpeed set to " << ctx_.speed << " m/s" << std::endl;
 
   tmin_ = tmax_ = 0;
-  matp_ = opt.matching_period;
+  parking_ = true;
+  ctx_.matp = opt.matching_period;
   sleep_interval_ = std::round((float)1000 / opt.time_multiplier);
-  original_speed_ = speed_; // used to restore the speed after sim ends if "full sim" is off
+  original_speed_ = ctx_.speed; // used to restore the speed after sim ends if "full sim" is off
   full_sim_ = opt.full_sim;
 
   print << "Creating in-memory database..." << std::endl;
-  if (sqlite3_open(":memory:", &db_) != SQLITE_OK) {
+  if (sqlite3_open(":memory:", &ctx_.db) != SQLITE_OK) {
     print(MessageType::Error) << "Failed (create db). Reason:\n";
-    throw std::runtime_error(sqlite3_errmsg(db_));
+    throw std::runtime_error(sqlite3_errmsg(ctx_.db));
   }
 
   database_file_ = opt.path_to_save;
 
   /* Enable foreign keys */
-  if (sqlite3_db_config(db_, SQLITE_DBCONFIG_ENABLE_FKEY, 1, NULL) != SQLITE_OK) {
+  if (sqlite3_db_config(ctx_.db, SQLITE_DBCONFIG_ENABLE_FKEY, 1, NULL) != SQLITE_OK) {
     print(MessageType::Error) << "Failed (enable foreign keys). Reason:\n";
-    throw std::runtime_error(sqlite3_errmsg(db_));
+    throw std::runtime_error(sqlite3_errmsg(ctx_.db));
   }
 
   /* Performance enhancements */
-  sqlite3_exec(db_, "PRAGMA synchronous = OFF", NULL, NULL, &err);
-  sqlite3_exec(db_, "PRAGMA journal_mode = OFF", NULL, NULL, &err);
-  sqlite3_exec(db_, "PRAGMA locking_mode = EXCLUSIVE", NULL, NULL, &err);
+  sqlite3_exec(ctx_.db, "PRAGMA synchronous = OFF", NULL, NULL, &err);
+  sqlite3_exec(ctx_.db, "PRAGMA journal_mode = OFF", NULL, NULL, &err);
+  sqlite3_exec(ctx_.db, "PRAGMA locking_mode = EXCLUSIVE", NULL, NULL, &err);
 
   print << "\tCreating Cargo tables..." << std::endl;
-  if (sqlite3_exec(db_, sql::create_cargo_tables, NULL, NULL, &err) != SQLITE_OK) {
+  if (sqlite3_exec(ctx_.db, sql::create_cargo_tables, NULL, NULL, &err) != SQLITE_OK) {
     print(MessageType::Error) << "Failed (create cargo tables). Reason: " << err << "\n";
     print << sql::create_cargo_tables << "\n";
     throw std::runtime_error("create cargo tables failed.");
@@ -830,213 +1721,138 @@ void Cargo::initialize(const Options& opt) {
   print << "\t\tDone" << std::endl;
 
   print << "\tInserting nodes..." << std::endl;
-  sqlite3_exec(db_, "BEGIN", NULL, NULL, &err);
+  sqlite3_exec(ctx_.db, "BEGIN", NULL, NULL, &err);
+  /* Nodes go in NODE_BATCH rows per statement; the remainder one at a time */
+  const size_t NODE_BATCH = 256;  // 3*256 bound parameters (SQLite max. 999)
+  std::string insert_nodes_sql = "insert into nodes values(?, ?, ?)";
+  for (size_t k = 1; k < NODE_BATCH; ++k)
+    insert_nodes_sql += ",(?, ?, ?)";
+  sqlite3_stmt* insert_nodes_stmt;
   sqlite3_stmt* insert_node_stmt;
-  if (sqlite3_prepare_v2(db_, "insert into nodes values(?, ?, ?);", -1, &insert_node_stmt, NULL) != SQLITE_OK) {
+  if (sqlite3_prepare_v2(ctx_.db, (insert_nodes_sql+";").c_str(), -1, &insert_nodes_stmt, NULL) != SQLITE_OK ||
+      sqlite3_prepare_v2(ctx_.db, "insert into nodes values(?, ?, ?);", -1, &insert_node_stmt, NULL) != SQLITE_OK) {
     print(MessageType::Error) << "Failed (create insert node stmt). Reason:\n";
-    throw std::runtime_error(sqlite3_errmsg(db_));
+    throw std::runtime_error(sqlite3_errmsg(ctx_.db));
   }
-  for (const auto& kv : nodes_) {
-    sqlite3_bind_int(insert_node_stmt, 1, kv.first);
-    sqlite3_bind_double(insert_node_stmt, 2, kv.second.lng);
-    sqlite3_bind_double(insert_node_stmt, 3, kv.second.lat);
-    if (sqlite3_step(insert_node_stmt) != SQLITE_DONE) {
-      print(MessageType::Error) << "Failure at node " << kv.first << "\n";
+  for (size_t i = 0; i < graph().size(); ) {
+    const size_t nrows = (i + NODE_BATCH <= graph().size() ? NODE_BATCH : 1);
+    sqlite3_stmt* stmt = (nrows == 1 ? insert_node_stmt : insert_nodes_stmt);
+    for (size_t k = 0; k < nrows; ++k) {
+      sqlite3_bind_int(stmt, 3*k+1, graph().id[i+k]);
+      sqlite3_bind_double(stmt, 3*k+2, graph().lng[i+k]);
+      sqlite3_bind_double(stmt, 3*k+3, graph().lat[i+k]);
+    }
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+      print(MessageType::Error) << "Failure at node " << graph().id[i] << "\n";
       print(MessageType::Error) << "Failed (insert nodes). Reason:\n";
-      throw std::runtime_error(sqlite3_errmsg(db_));
+      throw std::runtime_error(sqlite3_errmsg(ctx_.db));
     }
-    sqlite3_clear_bindings(insert_node_stmt);
-    sqlite3_reset(insert_node_stmt);
+    sqlite3_clear_bindings(stmt);
+    sqlite3_reset(stmt);
+    i += nrows;
   }
+  sqlite3_finalize(insert_nodes_stmt);
   sqlite3_finalize(insert_node_stmt);
-  sqlite3_exec(db_, "END", NULL, NULL, &err);
+  sqlite3_exec(ctx_.db, "END", NULL, NULL, &err);
   print << "\t\tDone" << std::endl;
 
-  print << "\tInserting trips..." << std::endl;
-  sqlite3_stmt* insert_vehicle_stmt;
-  sqlite3_stmt* insert_customer_stmt;
-  sqlite3_stmt* insert_stop_stmt;
-  if (sqlite3_prepare_v2(db_, "insert into vehicles values(?,?,?,?,?,?,?,?,?,?,?,?);", -1, &insert_vehicle_stmt, NULL) != SQLITE_OK ||
-      sqlite3_prepare_v2(db_, "insert into customers values(?, ?, ?, ?, ?, ?, ?, ?);", -1, &insert_customer_stmt, NULL) != SQLITE_OK ||
-      sqlite3_prepare_v2(db_, "insert into stops values(?, ?, ?, ?, ?, ?);", -1, &insert_stop_stmt, NULL) != SQLITE_OK) {
-    print(MessageType::Error) << "Failed (create insert trip stmts). Reason:\n";
-    throw std::runtime_error(sqlite3_errmsg(db_));
-  }
-
-  // this->log_v_ = {};
-
-  for (const auto& kv : probset_.trips()) {
-    for (const auto& trip : kv.second) {
-      StopType stop_type = StopType::CustOrig;  // default
-
-      /* Insert vehicle (negative load) */
-      if (trip.load() < 0) {
-        total_vehicles_++;
-        stop_type = StopType::VehlOrig;
-
-        /* Sanity check */
-        if (trip.dest() == -1 && trip.late() != -1) {
-          print(MessageType::Error) << "Vehicle " << trip.id() << " has a late window with no destination\n";
-          throw std::runtime_error("bad vehicle");
-        }
-
-        /* Compute initial route
-         * (taxis have no initial route) */
-        NodeId trip_dest = trip.dest();
-        // while (trip_dest == -1 || trip_dest == trip.orig())
-        //   trip_dest = random_node();
-        if (trip_dest == -1)
-          trip_dest = trip.orig();
-        Stop a(trip.id(), trip.orig(), StopType::VehlOrig, trip.early(), trip.late(), trip.early());
-        Stop b(trip.id(), trip_dest  , StopType::VehlDest, trip.early(), trip.late());
-        vec_t<Wayp> rte;
-        DistInt cost = route_through({a,b}, rte, false);
-
-        /* Initialize vehicle schedule */
-        vec_t<Stop> sch;
-        if (trip.late() != -1) {
-          Stop next_loc(trip.id(), rte.at(1).second, StopType::VehlOrig, trip.early(), trip.late());
-          sch.push_back(next_loc);
-          sch.push_back(b);
-        } else {
-          sch.push_back(a);
-          sch.push_back(b);
-        }
-
-        /* Log initial position */
-        // log_v_[trip.id()] = {trip.orig()};
-        Logger::put_r_message(rte, trip.id(), 0);
-
-        /* Insert to database */
-        sqlite3_bind_int(insert_vehicle_stmt, 1, trip.id());
-        sqlite3_bind_int(insert_vehicle_stmt, 2, trip.orig());
-        sqlite3_bind_int(insert_vehicle_stmt, 3, trip.dest());
-        sqlite3_bind_int(insert_vehicle_stmt, 4, trip.early());
-        sqlite3_bind_int(insert_vehicle_stmt, 5, trip.late());
-        sqlite3_bind_int(insert_vehicle_stmt, 6, trip.load());
-        sqlite3_bind_int(insert_vehicle_stmt, 7, 0);
-        sqlite3_bind_int(insert_vehicle_stmt, 8, (int)VehlStatus::Enroute);
-        sqlite3_bind_blob(insert_vehicle_stmt, 9,
-          static_cast<void const*>(rte.data()),rte.size()*sizeof(Wayp),SQLITE_TRANSIENT);
-        sqlite3_bind_int(insert_vehicle_stmt,10, 0);
-        if (trip.late() != -1)
-          sqlite3_bind_int(insert_vehicle_stmt,11, rte.at(1).first);
-        else
-          sqlite3_bind_int(insert_vehicle_stmt,11, 0);
-        sqlite3_bind_blob(insert_vehicle_stmt,12,
-          static_cast<void const*>(sch.data()),sch.size()*sizeof(Stop),SQLITE_TRANSIENT);
-        if (sqlite3_step(insert_vehicle_stmt) != SQLITE_DONE) {
-          print(MessageType::Error) << "Failure at vehicle " << trip.id() << "\n";
-          print(MessageType::Error) << "Failed (insert vehicle). Reason:\n";
-          throw std::runtime_error(sqlite3_errmsg(db_));
-        }
-        sqlite3_clear_bindings(insert_vehicle_stmt);
-        sqlite3_reset(insert_vehicle_stmt);
-
-        /* Record base cost (for rs vehicles) */
-        if (trip.dest() == -1) cost = 0;
-        base_cost_ += cost;
-        trip_costs_[trip.id()] = cost;
-
-      /* Insert customer (positive load) */
-      } else if (trip.load() > 0) {
-        total_customers_++;
-
-        /* Compute initial route */
-        Stop a(trip.id(), trip.orig(), StopType::CustOrig, trip.early(), trip.late(), trip.early());
-        Stop b(trip.id(), trip.dest(), StopType::CustDest, trip.early(), trip.late());
-        vec_t<Wayp> rte;
-        DistInt cost = route_through({a, b}, rte, false);
-
-        /* Record base cost */
-        base_cost_ += cost;
-        trip_costs_[trip.id()] = cost;
-        stop_type = StopType::CustOrig;
-
-        /* Insert to local index */
-        Customer cust(trip.id(), trip.orig(), trip.dest(), trip.early(), trip.late(), trip.load(), CustStatus::Waiting);
-        customers_[trip.id()] = cust;
-
-        /* Insert to database */
-        sqlite3_bind_int(insert_customer_stmt, 1, trip.id());
-        sqlite3_bind_int(insert_customer_stmt, 2, trip.orig());
-        sqlite3_bind_int(insert_customer_stmt, 3, trip.dest());
-        sqlite3_bind_int(insert_customer_stmt, 4, trip.early());
-        sqlite3_bind_int(insert_customer_stmt, 5, trip.late());
-        sqlite3_bind_int(insert_customer_stmt, 6, trip.load());
-        sqlite3_bind_int(insert_customer_stmt, 7, (int)CustStatus::Waiting);
-        sqlite3_bind_null(insert_customer_stmt, 8);
-        if (sqlite3_step(insert_customer_stmt) != SQLITE_DONE) {
-          print(MessageType::Error) << "Failure at customer " << trip.id() << "\n";
-          print(MessageType::Error) << "Failed (insert customer). Reason:\n";
-          throw std::runtime_error(sqlite3_errmsg(db_));
-        }
-        sqlite3_clear_bindings(insert_customer_stmt);
-        sqlite3_reset(insert_customer_stmt);
-
-      /* Insert small "customers", e.g. mail, packages (zero load) */
-      } else {
-        // placeholder
-        print(MessageType::Warning) << "Trip" << trip.id() << " load == 0\n";
-      }
-
-      /* Insert origin */
-      sqlite3_bind_int(insert_stop_stmt, 1, trip.id());
-      sqlite3_bind_int(insert_stop_stmt, 2, trip.orig());
-      sqlite3_bind_int(insert_stop_stmt, 3, (int)stop_type);
-      sqlite3_bind_int(insert_stop_stmt, 4, trip.early());
-      sqlite3_bind_int(insert_stop_stmt, 5, trip.late());
-      sqlite3_bind_int(insert_stop_stmt, 6, -1);
-      if (sqlite3_step(insert_stop_stmt) != SQLITE_DONE) {
-        print(MessageType::Error) << "Failure at stop " << trip.orig() << "\n";
-        print(MessageType::Error) << "Failed (insert stop). Reason:\n";
-        throw std::runtime_error(sqlite3_errmsg(db_));
-      }
-      sqlite3_clear_bindings(insert_stop_stmt);
-      sqlite3_reset(insert_stop_stmt);
-
-      /* Insert destination */
-      sqlite3_bind_int(insert_stop_stmt, 1, trip.id());
-      sqlite3_bind_int(insert_stop_stmt, 2, trip.dest());
-      sqlite3_bind_int(insert_stop_stmt, 3, (int)stop_type + 1);
-      sqlite3_bind_int(insert_stop_stmt, 4, trip.early());
-      sqlite3_bind_int(insert_stop_stmt, 5, trip.late());
-      sqlite3_bind_int(insert_stop_stmt, 6, -1);
-      if (sqlite3_step(insert_stop_stmt) != SQLITE_DONE) {
-        print(MessageType::Error) << "Failure at stop " << trip.dest() << "\n";
-        print(MessageType::Error) << "Failed (insert stop). Reason:\n";
-        throw std::runtime_error(sqlite3_errmsg(db_));
-      }
-      sqlite3_clear_bindings(insert_stop_stmt);
-      sqlite3_reset(insert_stop_stmt);
-
+  /* Trips are inserted into the database as they appear (see admit()) */
+  next_trip_ = 0;
+  total_traveled_ = total_penalty_ = 0;
+  sum_pickup_delay_ = sum_trip_delay_ = 0;
+  npickups_ = ndropoffs_ = ntimeouts_ = 0;
+  metrics_interval_ = opt.metrics_interval;
+  checkpoint_interval_ = opt.checkpoint_interval;
+  checkpoint_spcache_ = opt.checkpoint_spcache;
+  resumed_ = false;
+  ctx_.events.clear();
+  ctx_.segments.clear();
+  segments_live_ = 0;
+  ctx_.wheel.assign(ctx_.matp + 2, {});
+  ctx_.nwaiting = 0;
+  if (stream_.is_open()) {
+    index_trips(stream_.ids(), ctx_.trips);
+    total_vehicles_ = stream_.vehicles();
+    total_customers_ = stream_.customers();
+    tmin_ = stream_.max_early();
+    tmax_ = stream_.max_late();
+    if (stream_.has_costs())
+      print << "\tUsing precomputed base costs" << std::endl;
+    else
+      print(MessageType::Warning) << "Compiled for another road network; base costs are computed on arrival\n";
+  } else {
+    /* Trips are handled in order of appearance (ties in file order) */
+    trips_.clear();
+    for (const auto& kv : probset_.trips())
+      for (const auto& trip : kv.second)
+        trips_.push_back(trip);
+    std::stable_sort(trips_.begin(), trips_.end(), [](const Trip& a, const Trip& b) {
+      return a.early() < b.early(); });
+    probset_.set_trips({});  // trips_ has them now
+
+    vec_t<TripId> ids;
+    ids.reserve(trips_.size());
+    for (const Trip& trip : trips_) {
+      ids.push_back(trip.id());
+      if (trip.load() < 0) total_vehicles_++;
+      if (trip.load() > 0) total_customers_++;
       /* Get tmin_, tmax_ */
       tmin_ = std::max(trip.early(), tmin_);
       tmax_ = std::max(trip.late(), tmax_);
     }
+    index_trips(std::move(ids), ctx_.trips);
+
+    /* Base costs and initial vehicle routes are independent shortest-path
+     * queries, so compute them all in parallel before the simulation starts.
+     * Customers only need the distance; their route would be discarded. */
+    init_costs_.assign(trips_.size(), 0);
+    init_rtes_.assign(trips_.size(), {});
+    std::atomic<size_t> next_trip(0);
+    std::exception_ptr failure = nullptr;
+    std::mutex failure_mx;
+    auto precompute = [&]() {
+      bind();
+      try {
+        for (size_t i = next_trip++; i < trips_.size(); i = next_trip++)
+          init_costs_[i] = base_cost(trips_.at(i), init_rtes_[i]);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(failure_mx);
+        if (!failure) failure = std::current_exception();
+        next_trip = trips_.size();  // stop the other workers
+      }
+    };
+    vec_t<std::thread> workers;
+    for (unsigned k = 1; k < std::thread::hardware_concurrency(); ++k)
+      workers.emplace_back(precompute);
+    precompute();
+    for (std::thread& worker : workers) worker.join();
+    if (failure) std::rethrow_exception(failure);
   }
-  sqlite3_exec(db_, "END", NULL, NULL, &err);
+
+  /* Size the per-trip tables for all the trips up front */
+  const size_t nids = ctx_.trips.size();
+  ctx_.trip_costs.assign(nids, -1);
+  ctx_.customers.assign(nids, {});
+  ctx_.retired.assign(nids, {-1, -1, -1, -1, false});
+  ctx_.visited.assign(nids, StopsVisited::Absent);
+  pickup_t_.assign(nids, -1);
 
   active_vehicles_ = total_vehicles_;
 
   // Minimum sim time equals time of last trip appearing, plus matching pd.
-  tmin_ += matp_;
-
-  static_mode = opt.static_mode;
-  strict_mode = opt.strict_mode;
+  tmin_ += ctx_.matp;
 
-  if (static_mode) print(MessageType::Warning) << "Using static mode" << std::endl;
-  if (strict_mode) print(MessageType::Warning) << "Using strict mode" << std::endl;
+  ctx_.static_mode = opt.static_mode;
+  ctx_.strict_mode = opt.strict_mode;
 
-  sqlite3_finalize(insert_vehicle_stmt);
-  sqlite3_finalize(insert_customer_stmt);
-  sqlite3_finalize(insert_stop_stmt);
+  if (ctx_.static_mode) print(MessageType::Warning) << "Using static mode" << std::endl;
+  if (ctx_.strict_mode) print(MessageType::Warning) << "Using strict mode" << std::endl;
 
-  t_ = 0;  // Ready to begin!
+  if (opt.spcache_warmup > 0)
+    warm_spcache(opt.path_to_problem, opt.spcache_warmup);
 
-  // Logger::put_v_message(log_v_);
+  ctx_.t = 0;  // Ready to begin!
 
-  print << "\t\tDone" << std::endl;
   print << "Finished initialization sequence" << std::endl;
 }
 
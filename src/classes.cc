@@ -21,6 +21,7 @@
 // SOFTWARE.
 #include <algorithm>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -60,47 +61,64 @@ const SimlTime  & Stop::visitedAt() const { return visitedAt_; }
 
 
 /* Schedule ------------------------------------------------------------------*/
+/* Default-constructed Schedules (and Routes) share one empty buffer */
+static const std::shared_ptr<const vec_t<Stop>> & no_stops() {
+  static const std::shared_ptr<const vec_t<Stop>> empty
+    = std::make_shared<const vec_t<Stop>>();
+  return empty;
+}
+
+Schedule::Schedule() : owner_(), data_(no_stops()) {}
+
 Schedule::Schedule(
   VehlId owner,
   vec_t<Stop> data)
 {
   this->owner_ = owner;
-  this->data_ = data;
+  this->data_ = std::make_shared<const vec_t<Stop>>(std::move(data));
 }
 
 const VehlId            & Schedule::owner()      const { return owner_; }
-const vec_t<Stop>       & Schedule::data()       const { return data_; }
-const Stop              & Schedule::at(SchIdx i) const { return data_.at(i); }
-const Stop              & Schedule::front()      const { return data_.front(); }
-const Stop              & Schedule::back()       const { return data_.back(); }
-      size_t              Schedule::size()       const { return data_.size(); }
+const vec_t<Stop>       & Schedule::data()       const { return *data_; }
+const Stop              & Schedule::at(SchIdx i) const { return data_->at(i); }
+const Stop              & Schedule::front()      const { return data_->front(); }
+const Stop              & Schedule::back()       const { return data_->back(); }
+      size_t              Schedule::size()       const { return data_->size(); }
 
 void Schedule::print() const {
-  for (const auto & stop : data_)
+  for (const auto & stop : *data_)
     std::cout << stop.loc() << " ";
   std::cout << std::endl;
 }
 
 
 /* Route ---------------------------------------------------------------------*/
+static const std::shared_ptr<const vec_t<Wayp>> & no_wayps() {
+  static const std::shared_ptr<const vec_t<Wayp>> empty
+    = std::make_shared<const vec_t<Wayp>>();
+  return empty;
+}
+
+Route::Route() : owner_(), data_(no_wayps()) {}
+
 Route::Route(
   VehlId owner,
   vec_t<Wayp> data)
 {
   this->owner_ = owner;
-  this->data_ = data;
+  this->data_ = std::make_shared<const vec_t<Wayp>>(std::move(data));
 }
 
 const VehlId      & Route::owner()           const { return owner_; }
-const vec_t<Wayp> & Route::data()            const { return data_; }
-const NodeId      & Route::node_at(RteIdx i) const { return data_.at(i).second; }
-const DistInt     & Route::dist_at(RteIdx i) const { return data_.at(i).first; }
-const DistInt     & Route::cost()            const { return data_.back().first; }
-const Wayp        & Route::at(RteIdx i)      const { return data_.at(i); }
-      size_t        Route::size()            const { return data_.size(); }
+const vec_t<Wayp> & Route::data()            const { return *data_; }
+const NodeId      & Route::node_at(RteIdx i) const { return data_->at(i).second; }
+const DistInt     & Route::dist_at(RteIdx i) const { return data_->at(i).first; }
+const DistInt     & Route::cost()            const { return data_->back().first; }
+const Wayp        & Route::at(RteIdx i)      const { return data_->at(i); }
+      size_t        Route::size()            const { return data_->size(); }
 
 void Route::print() const {
-  for (const auto & wp : data_)
+  for (const auto & wp : *data_)
     std::cout << "(" << wp.first << "|" << wp.second << ") ";
   std::cout << std::endl;
 }
@@ -174,7 +192,7 @@ Vehicle::Vehicle(
   Stop d(vid, did, StopType::VehlDest, et, lt);      // create destination
   vec_t<Wayp> route_data{};                          // container for route
   route_through({o, d}, route_data, gtree);          // compute route
-  Route rte(vid, route_data);                        // construct Route
+  Route rte(vid, std::move(route_data));             // construct Route
 
   /* Initialize default schedule
    * (first stop equals vehicle's next location in route) */
@@ -201,13 +219,15 @@ Vehicle::Vehicle(
   Route r,
   Schedule s,
   RteIdx ri,
-  VehlStatus f)
+  VehlStatus f,
+  Version v)
     : Trip(vid, oid, did, e, l, ld), route_(r), schedule_(s)
 {
   this->next_node_distance_ = nnd;
   this->idx_last_visited_node_ = ri;
   this->queued_ = qd;
   this->status_ = f;
+  this->version_ = v;
 }
 
 const DistInt    & Vehicle::next_node_distance()    const { return next_node_distance_; }
@@ -216,6 +236,7 @@ const Schedule   & Vehicle::schedule()              const { return schedule_; }
 const RteIdx     & Vehicle::idx_last_visited_node() const { return idx_last_visited_node_; }
 const NodeId     & Vehicle::last_visited_node()     const { return route_.node_at(idx_last_visited_node_); }
 const VehlStatus & Vehicle::status()                const { return status_; }
+const Version    & Vehicle::version()               const { return version_; }
       Load         Vehicle::queued()                const { return queued_; }
       Load         Vehicle::capacity()              const { return -load_; }
       DistInt      Vehicle::remaining()             const { return this->route().cost() - this->traveled(); }
@@ -260,6 +281,10 @@ void MutableVehicle::set_rte(const vec_t<Wayp> & r) {
   set_rte(route);
 }
 
+void MutableVehicle::set_rte(vec_t<Wayp> && r) {
+  this->route_ = Route(this->id_, std::move(r));
+}
+
 void MutableVehicle::set_rte(const Route & route) {
   this->route_ = route;
 }
@@ -269,6 +294,10 @@ void MutableVehicle::set_sch(const vec_t<Stop> & s) {
   set_sch(schedule);
 }
 
+void MutableVehicle::set_sch(vec_t<Stop> && s) {
+  this->schedule_ = Schedule(this->id_, std::move(s));
+}
+
 void MutableVehicle::set_sch(const Schedule & schedule) {
   this->schedule_ = schedule;
 }
@@ -281,6 +310,10 @@ void MutableVehicle::set_lvn(const RteIdx & lvn) {
   this->idx_last_visited_node_ = lvn;
 }
 
+void MutableVehicle::set_version(const Version & v) {
+  this->version_ = v;
+}
+
 void MutableVehicle::reset_lvn()    { this->idx_last_visited_node_ = 0; }
 void MutableVehicle::incr_queued()  { this->queued_++; }  // when is "queued" used??
 void MutableVehicle::decr_queued()  { this->queued_--; }
@@ -0,0 +1,64 @@
+// MIT License
+//
+// Copyright (c) 2018 the Cargo authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <atomic>
+
+#include "libcargo/classes.h"
+#include "libcargo/events.h"
+#include "libcargo/types.h"
+
+namespace cargo {
+
+EventQueue::EventQueue() {
+  head_ = tail_ = new Node();
+  head_->next.store(nullptr);
+}
+
+EventQueue::~EventQueue() {
+  clear();
+  delete head_;
+}
+
+void EventQueue::push(const CustEvent& ev) {
+  Node* node = new Node();
+  node->ev = ev;
+  node->next.store(nullptr, std::memory_order_relaxed);
+  /* Publish; the release pairs with the acquire in pop() */
+  tail_->next.store(node, std::memory_order_release);
+  tail_ = node;
+}
+
+bool EventQueue::pop(CustEvent& ev) {
+  Node* next = head_->next.load(std::memory_order_acquire);
+  if (next == nullptr) return false;
+  ev = next->ev;
+  delete head_;  // the producer is done with it (it has moved on to next)
+  head_ = next;
+  return true;
+}
+
+void EventQueue::clear() {
+  CustEvent _;
+  while (pop(_)) {}
+  tail_ = head_;
+}
+
+}  // namespace cargo
@@ -20,16 +20,26 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 #include <algorithm> /* min(), max() */
+#include <cctype>
 #include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
 #include <fstream>
+#include <limits>
 #include <map>
 #include <mutex>
 #include <queue>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "libcargo/cargo.h"
 #include "libcargo/classes.h"
 #include "libcargo/file.h"
@@ -66,56 +76,401 @@ Speed parse_speed(const std::string& fn) {
   return -1;
 }
 
-size_t read_nodes(const Filepath& path, KVNodes& N) {
-  std::ifstream ifs(path);
-  if (!ifs.good()) throw std::runtime_error("node path not found");
-  N.clear();
-  NodeId oid, did;
-  Lat oy, dy;
-  Lon ox, dx;
-  int _;  // unused
-  while (ifs >> _ >> oid >> did >> ox >> oy >> dx >> dy) {
-    N[oid] = {ox, oy};
-    N[did] = {dx, dy};
+/* Read-only memory map of a whole file (empty files are not mapped). */
+class MappedFile {
+ public:
+  MappedFile(const Filepath& path) : data_(nullptr), size_(0) {
+    fd_ = open(path.c_str(), O_RDONLY);
+    if (fd_ == -1) return;
+    struct stat st;
+    if (fstat(fd_, &st) == 0 && st.st_size > 0) {
+      void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+      if (p != MAP_FAILED) {
+        data_ = static_cast<const char*>(p);
+        size_ = st.st_size;
+        madvise(p, size_, MADV_SEQUENTIAL);
+      }
+    }
   }
-  ifs.close();
-  return N.size();
+  ~MappedFile() {
+    if (data_ != nullptr) munmap(const_cast<char*>(data_), size_);
+    if (fd_ != -1) close(fd_);
+  }
+  bool good() const { return fd_ != -1; }
+  const char* begin() const { return data_; }
+  const char* end() const { return data_ + size_; }
+
+ private:
+  int fd_;
+  const char* data_;
+  size_t size_;
+};
+
+/* Fast number parsers for the road network files. Each skips leading white
+ * space, parses one token at p and advances p past it; returns false (without
+ * advancing) if there is no number at p. */
+static inline void skip_space(const char*& p, const char* end) {
+  while (p < end && std::isspace((unsigned char)*p)) ++p;
+}
+
+static inline bool parse_num(const char*& p, const char* end, int& out) {
+  skip_space(p, end);
+  const char* q = p;
+  bool neg = false;
+  if (q < end && (*q == '-' || *q == '+')) neg = (*q++ == '-');
+  if (q == end || !std::isdigit((unsigned char)*q)) return false;
+  long v = 0;
+  while (q < end && std::isdigit((unsigned char)*q)) v = v*10 + (*q++ - '0');
+  out = neg ? -v : v;
+  p = q;
+  return true;
+}
+
+/* The fast path (at most 15 significant digits, power of ten at most 22) is
+ * exact, as both operands are exact doubles; anything else goes to strtod so
+ * results always match what ifstream would have produced. */
+static inline bool parse_num(const char*& p, const char* end, double& out) {
+  static const double p10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+    1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+    1e21, 1e22};
+  skip_space(p, end);
+  const char* q = p;
+  bool neg = false;
+  if (q < end && (*q == '-' || *q == '+')) neg = (*q++ == '-');
+  unsigned long long m = 0;
+  int ndigits = 0, exp10 = 0;
+  bool any = false;
+  for (; q < end && std::isdigit((unsigned char)*q); ++q, any = true)
+    if (m || *q != '0') { m = m*10 + (*q - '0'); ++ndigits; }
+  if (q < end && *q == '.') {
+    for (++q; q < end && std::isdigit((unsigned char)*q); ++q, any = true) {
+      if (m || *q != '0') { m = m*10 + (*q - '0'); ++ndigits; }
+      --exp10;
+    }
+  }
+  if (any && q < end && (*q == 'e' || *q == 'E')) {
+    const char* r = q + 1;
+    bool eneg = false;
+    if (r < end && (*r == '-' || *r == '+')) eneg = (*r++ == '-');
+    if (r < end && std::isdigit((unsigned char)*r)) {
+      int e = 0;
+      while (r < end && std::isdigit((unsigned char)*r) && e < 10000)
+        e = e*10 + (*r++ - '0');
+      exp10 += eneg ? -e : e;
+      q = r;
+    }
+  }
+  if (any && ndigits <= 15 && exp10 >= -22 && exp10 <= 22
+      && (q == end || std::isspace((unsigned char)*q))) {
+    out = exp10 < 0 ? m / p10[-exp10] : m * p10[exp10];
+    if (neg) out = -out;
+    p = q;
+    return true;
+  }
+  // Slow path: let strtod handle the token
+  q = p;
+  while (q < end && !std::isspace((unsigned char)*q)) ++q;
+  const std::string tok(p, q);
+  char* tok_end = nullptr;
+  out = std::strtod(tok.c_str(), &tok_end);
+  if (tok.empty() || *tok_end != '\0') return false;
+  p = q;
+  return true;
+}
+
+/* Split [begin, end) into about one chunk per hardware thread, each chunk
+ * ending at a line break, and call f(chunk_begin, chunk_end, k) for every
+ * chunk k in parallel. Returns the number of chunks. Small inputs are parsed
+ * in one chunk. */
+template <typename F>
+static size_t parse_chunks(const char* begin, const char* end, F f) {
+  const size_t min_chunk = 1 << 20;
+  size_t nchunks = std::max(1u, std::thread::hardware_concurrency());
+  nchunks = std::max((size_t)1, std::min(nchunks, (size_t)(end-begin)/min_chunk));
+  vec_t<const char*> cut = {begin};
+  for (size_t k = 1; k < nchunks; ++k) {
+    const char* c = std::max(cut.back(), begin + (end-begin)*k/nchunks);
+    while (c < end && *c != '\n') ++c;
+    cut.push_back(c);
+  }
+  cut.push_back(end);
+  vec_t<std::thread> workers;
+  for (size_t k = 1; k < nchunks; ++k)
+    workers.emplace_back(f, cut[k], cut[k+1], k);
+  f(cut[0], cut[1], 0);
+  for (std::thread& w : workers) w.join();
+  return nchunks;
+}
+
+/* Rebuild the original-id to dense-index lookup table of G. Ids are expected
+ * to be (nearly) contiguous, as G-tree already requires, so the table is a
+ * plain array spanning the smallest to the largest id. */
+static void index_nodes(RoadGraph& G) {
+  G.dense.clear();
+  if (G.id.empty()) return;
+  const auto mm = std::minmax_element(G.id.begin(), G.id.end());
+  G.base = *mm.first;
+  G.dense.assign((size_t)((long)*mm.second - G.base + 1), -1);
+  for (size_t i = 0; i < G.id.size(); ++i)
+    G.dense[G.id[i] - G.base] = i;
 }
 
-size_t read_nodes(const Filepath& path, KVNodes& N, BoundingBox& bbox) {
-  read_nodes(path, N);
+size_t read_nodes(const Filepath& path, RoadGraph& G) {
+  MappedFile f(path);
+  if (!f.good()) throw std::runtime_error("node path not found");
+  G = {};
+  // Each line is "_ oid did ox oy dx dy"
+  vec_t<vec_t<std::pair<NodeId, Point>>> part(
+    std::max(1u, std::thread::hardware_concurrency()));
+  const size_t nchunks = parse_chunks(f.begin(), f.end(),
+      [&](const char* p, const char* end, size_t k) {
+    NodeId oid, did;
+    Lat oy, dy;
+    Lon ox, dx;
+    int _;  // unused
+    while (parse_num(p, end, _) && parse_num(p, end, oid)
+        && parse_num(p, end, did) && parse_num(p, end, ox)
+        && parse_num(p, end, oy) && parse_num(p, end, dx)
+        && parse_num(p, end, dy)) {
+      part[k].push_back({oid, {ox, oy}});
+      part[k].push_back({did, {dx, dy}});
+    }
+  });
+  // Dense indices follow the order of the original ids; if a node appears more
+  // than once, its last coordinates are kept.
+  NodeId lo = std::numeric_limits<NodeId>::max();
+  NodeId hi = std::numeric_limits<NodeId>::min();
+  for (size_t k = 0; k < nchunks; ++k)
+    for (const auto& kv : part[k]) {
+      lo = std::min(lo, kv.first);
+      hi = std::max(hi, kv.first);
+    }
+  if (lo > hi) return 0;
+  vec_t<Point> pts((size_t)((long)hi - lo + 1));
+  vec_t<char> seen(pts.size(), 0);
+  for (size_t k = 0; k < nchunks; ++k)
+    for (const auto& kv : part[k]) {
+      pts[kv.first - lo] = kv.second;
+      seen[kv.first - lo] = 1;
+    }
+  for (size_t i = 0; i < pts.size(); ++i)
+    if (seen[i]) {
+      G.id.push_back(lo + i);
+      G.lng.push_back(pts[i].lng);
+      G.lat.push_back(pts[i].lat);
+    }
+  index_nodes(G);
+  return G.size();
+}
+
+size_t read_nodes(const Filepath& path, RoadGraph& G, BoundingBox& bbox) {
+  read_nodes(path, G);
   Lon min_lng = 180, max_lng = -180;
   Lat min_lat = 90, max_lat = -90;
-  for (const auto& kv : N) {
-    max_lng = std::max(max_lng, kv.second.lng);
-    max_lat = std::max(max_lat, kv.second.lat);
-    min_lng = std::min(min_lng, kv.second.lng);
-    min_lat = std::min(min_lat, kv.second.lat);
+  for (size_t i = 0; i < G.size(); ++i) {
+    max_lng = std::max(max_lng, G.lng[i]);
+    max_lat = std::max(max_lat, G.lat[i]);
+    min_lng = std::min(min_lng, G.lng[i]);
+    min_lat = std::min(min_lat, G.lat[i]);
   }
   bbox = {{min_lng, min_lat}, {max_lng, max_lat}};
-  return N.size();
+  return G.size();
 }
 
-size_t read_edges(const Filepath& path, KVEdges& M) {
-  std::ifstream ifs(path);
-  if (!ifs.good()) throw std::runtime_error("edge path not found");
-  M.clear();
-  std::string _;         // unused
-  std::getline(ifs, _);  // skip the header line
-  NodeId oid, did;
-  double weight;
+size_t read_edges(const Filepath& path, RoadGraph& G) {
+  MappedFile f(path);
+  if (!f.good()) throw std::runtime_error("edge path not found");
+  const char* begin = f.begin();
+  while (begin < f.end() && *begin != '\n') ++begin;  // skip the header line
+  // Each line is "oid did weight"
+  struct Edges { vec_t<NodeId> from, to; vec_t<DistDbl> w; };
+  vec_t<Edges> part(std::max(1u, std::thread::hardware_concurrency()));
+  const size_t nchunks = parse_chunks(begin, f.end(),
+      [&](const char* p, const char* end, size_t k) {
+    NodeId oid, did;
+    double weight;
+    while (parse_num(p, end, oid) && parse_num(p, end, did)
+        && parse_num(p, end, weight)) {
+      part[k].from.push_back(oid);
+      part[k].to.push_back(did);
+      part[k].w.push_back(weight);
+    }
+  });
   size_t count_edges = 0;
-  while (ifs >> oid >> did >> weight) {
-    M[oid][did] = weight;
-    M[did][oid] = weight;
-    M[oid][oid] = 0;
-    M[did][did] = 0;
-    count_edges++;
+  for (size_t k = 0; k < nchunks; ++k)
+    count_edges += part[k].w.size();
+
+  // Endpoints missing from the node file get a dense index (but no coordinates)
+  // so that their edge weights can still be looked up.
+  dict<NodeId, bool> missing;
+  for (size_t k = 0; k < nchunks; ++k)
+    for (const vec_t<NodeId>* ends : {&part[k].from, &part[k].to})
+      for (const NodeId& u : *ends)
+        if (G.index(u) == -1 && !missing.count(u)) {
+          missing[u] = true;
+          G.id.push_back(u);
+          G.lng.push_back(0);
+          G.lat.push_back(0);
+        }
+  if (!missing.empty()) index_nodes(G);
+
+  // Store both directions; self-loops are implicit (weight 0). Arcs are
+  // bucketed by tail in file order, then each (short) adjacency list is sorted
+  // by head; if an edge is given more than once, the last weight is kept.
+  G.off.assign(G.size() + 1, 0);
+  for (size_t k = 0; k < nchunks; ++k)
+    for (size_t e = 0; e < part[k].w.size(); ++e)
+      if (part[k].from[e] != part[k].to[e]) {
+        G.off[G.index(part[k].from[e]) + 1]++;
+        G.off[G.index(part[k].to[e]) + 1]++;
+      }
+  for (size_t i = 0; i < G.size(); ++i)
+    G.off[i+1] += G.off[i];
+  G.dst.assign(G.off.back(), -1);
+  G.wgt.assign(G.off.back(), 0);
+  vec_t<int> fill(G.off.begin(), G.off.end() - 1);
+  for (size_t k = 0; k < nchunks; ++k)
+    for (size_t e = 0; e < part[k].w.size(); ++e)
+      if (part[k].from[e] != part[k].to[e]) {
+        const int u = G.index(part[k].from[e]), v = G.index(part[k].to[e]);
+        G.dst[fill[u]] = v; G.wgt[fill[u]++] = part[k].w[e];
+        G.dst[fill[v]] = u; G.wgt[fill[v]++] = part[k].w[e];
+      }
+  int out = 0;
+  for (size_t i = 0; i < G.size(); ++i) {
+    const int first = G.off[i], last = G.off[i+1];
+    for (int a = first + 1; a < last; ++a)  // stable insertion sort
+      for (int b = a; b > first && G.dst[b-1] > G.dst[b]; --b) {
+        std::swap(G.dst[b-1], G.dst[b]);
+        std::swap(G.wgt[b-1], G.wgt[b]);
+      }
+    G.off[i] = out;
+    for (int a = first; a < last; ++a) {
+      if (a + 1 < last && G.dst[a+1] == G.dst[a]) continue;
+      G.dst[out] = G.dst[a];
+      G.wgt[out++] = G.wgt[a];
+    }
   }
-  ifs.close();
+  G.off.back() = out;
+  G.dst.resize(out);
+  G.wgt.resize(out);
   return count_edges;
 }
 
+void add_node(RoadGraph& G, const NodeId& u, const Point& pt) {
+  int i = G.index(u);
+  if (i == -1) {
+    i = G.size();
+    G.id.push_back(u);
+    G.lng.push_back(pt.lng);
+    G.lat.push_back(pt.lat);
+    if (!G.off.empty()) G.off.push_back(G.off.back());  // no edges
+    index_nodes(G);
+  } else {
+    G.lng[i] = pt.lng;
+    G.lat[i] = pt.lat;
+  }
+}
+
+size_t graph_stamp(const Filepath& rnet, const Filepath& edges) {
+  size_t stamp = 0;
+  for (const Filepath* path : {&rnet, &edges}) {
+    struct stat st;
+    if (stat(path->c_str(), &st) != 0) return 0;
+    stamp = stamp*1000003 ^ (size_t)st.st_size;
+    stamp = stamp*1000003 ^ (size_t)st.st_mtime;
+  }
+  return stamp == 0 ? 1 : stamp;
+}
+
+/* Binary road graph layout (native byte order):
+ *   char[8] "CARGORG1", uint64 stamp, uint64 #nodes, uint64 #arcs,
+ *   uint64 #edges read, double[4] bbox, NodeId id[#nodes], Lon lng[#nodes],
+ *   Lat lat[#nodes], int off[#nodes+1], int dst[#arcs], DistDbl wgt[#arcs] */
+static const char GRAPH_MAGIC[8] = {'C','A','R','G','O','R','G','1'};
+
+bool read_graph(const Filepath& path, const size_t& stamp, RoadGraph& G,
+                BoundingBox& bbox, size_t& nedges) {
+  std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+  if (!ifs.good()) return false;
+  const uint64_t size = ifs.tellg();
+  ifs.seekg(0);
+  char magic[8];
+  uint64_t hdr[4];
+  double box[4];
+  ifs.read(magic, sizeof(magic));
+  ifs.read(reinterpret_cast<char*>(hdr), sizeof(hdr));
+  ifs.read(reinterpret_cast<char*>(box), sizeof(box));
+  if (!ifs.good() || !std::equal(magic, magic + 8, GRAPH_MAGIC)
+      || (stamp != 0 && hdr[0] != stamp))
+    return false;
+
+  /* The counts must account for the rest of the file exactly (checked before
+   * multiplying, so that a corrupt count cannot overflow) */
+  const uint64_t n = hdr[1], m = hdr[2];
+  const uint64_t rest = size - ifs.tellg();
+  if (n >= (uint64_t)std::numeric_limits<int>::max() || n > rest
+   || m >= (uint64_t)std::numeric_limits<int>::max() || m > rest
+   || rest != n*(sizeof(NodeId) + sizeof(Lon) + sizeof(Lat))
+            + (n + 1)*sizeof(int) + m*(sizeof(int) + sizeof(DistDbl)))
+    return false;
+  G = {};
+  G.id.resize(n);
+  G.lng.resize(n);
+  G.lat.resize(n);
+  G.off.resize(n + 1);
+  G.dst.resize(m);
+  G.wgt.resize(m);
+  ifs.read(reinterpret_cast<char*>(G.id.data()),  G.id.size()*sizeof(NodeId));
+  ifs.read(reinterpret_cast<char*>(G.lng.data()), G.lng.size()*sizeof(Lon));
+  ifs.read(reinterpret_cast<char*>(G.lat.data()), G.lat.size()*sizeof(Lat));
+  ifs.read(reinterpret_cast<char*>(G.off.data()), G.off.size()*sizeof(int));
+  ifs.read(reinterpret_cast<char*>(G.dst.data()), G.dst.size()*sizeof(int));
+  ifs.read(reinterpret_cast<char*>(G.wgt.data()), G.wgt.size()*sizeof(DistDbl));
+
+  /* The edges of each node must lie within dst[], in order, and lead to
+   * nodes of the graph */
+  bool valid = ifs.good() && G.off[0] == 0 && G.off[n] == (int)m;
+  for (size_t i = 0; valid && i < n; ++i)
+    valid = (G.off[i] <= G.off[i+1]);
+  for (size_t e = 0; valid && e < m; ++e)
+    valid = (G.dst[e] >= 0 && (uint64_t)G.dst[e] < n);
+  if (!valid) {
+    G = {};
+    return false;
+  }
+  index_nodes(G);
+  bbox = {{box[0], box[1]}, {box[2], box[3]}};
+  nedges = hdr[3];
+  return true;
+}
+
+void write_graph(const Filepath& path, const size_t& stamp, const RoadGraph& G,
+                 const BoundingBox& bbox, const size_t& nedges) {
+  /* Write a temporary file and move it into place, so that another process
+   * loading the same network never reads a partly written graph */
+  const Filepath tmp = path + ".tmp" + std::to_string(getpid());
+  std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+  if (!ofs.good()) throw std::runtime_error("graph path not writable");
+  const uint64_t hdr[4] = {stamp, G.size(), G.dst.size(), nedges};
+  const double box[4] = {bbox.lower_left.lng, bbox.lower_left.lat,
+                         bbox.upper_right.lng, bbox.upper_right.lat};
+  ofs.write(GRAPH_MAGIC, sizeof(GRAPH_MAGIC));
+  ofs.write(reinterpret_cast<const char*>(hdr), sizeof(hdr));
+  ofs.write(reinterpret_cast<const char*>(box), sizeof(box));
+  ofs.write(reinterpret_cast<const char*>(G.id.data()),  G.id.size()*sizeof(NodeId));
+  ofs.write(reinterpret_cast<const char*>(G.lng.data()), G.lng.size()*sizeof(Lon));
+  ofs.write(reinterpret_cast<const char*>(G.lat.data()), G.lat.size()*sizeof(Lat));
+  ofs.write(reinterpret_cast<const char*>(G.off.data()), G.off.size()*sizeof(int));
+  ofs.write(reinterpret_cast<const char*>(G.dst.data()), G.dst.size()*sizeof(int));
+  ofs.write(reinterpret_cast<const char*>(G.wgt.data()), G.wgt.size()*sizeof(DistDbl));
+  ofs.close();
+  if (!ofs.good() || std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    throw std::runtime_error("graph write failed");
+  }
+}
+
 size_t read_problem(const Filepath& path, ProblemSet& probset) {
   std::ifstream ifs(path);
   if (!ifs.good()) throw std::runtime_error("problem path not found");
@@ -142,11 +497,243 @@ size_t read_problem(const Filepath& path, ProblemSet& probset) {
   return count_trips;
 }
 
-std::queue<std::string> Logger::queue_;
-std::condition_variable Logger::condition_;
-std::mutex Logger::mutex_;
+/* Number the trips 0..n-1 in increasing id order. The ids of an instance are
+ * usually consecutive, and then a trip's index is its offset from the
+ * smallest id; gaps only leave unused entries in the lookup table. */
+void index_trips(vec_t<TripId> ids, TripIndex& T) {
+  T = {};
+  if (ids.empty()) return;
+  std::sort(ids.begin(), ids.end());
+  if (std::adjacent_find(ids.begin(), ids.end()) != ids.end())
+    throw std::runtime_error("trip id not unique");
+  T.base = ids.front();
+  T.dense.assign((size_t)((long)ids.back() - T.base + 1), -1);
+  for (size_t i = 0; i < ids.size(); ++i)
+    T.dense[ids[i] - T.base] = i;
+  T.id = std::move(ids);
+}
+
+size_t graph_hash(const RoadGraph& G) {
+  // 64-bit FNV-1a over the node ids, coordinates and CSR arrays
+  uint64_t h = 14695981039346656037ULL;
+  auto mix = [&h](const void* data, size_t len) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < len; ++i) {
+      h ^= p[i];
+      h *= 1099511628211ULL;
+    }
+  };
+  mix(G.id.data(),  G.id.size()*sizeof(NodeId));
+  mix(G.lng.data(), G.lng.size()*sizeof(Lon));
+  mix(G.lat.data(), G.lat.size()*sizeof(Lat));
+  mix(G.off.data(), G.off.size()*sizeof(int));
+  mix(G.dst.data(), G.dst.size()*sizeof(int));
+  mix(G.wgt.data(), G.wgt.size()*sizeof(DistDbl));
+  return h;
+}
+
+/* Compiled instance layout (native byte order):
+ *   char[8] "CARGOPB1", uint64 road hash, uint64 name length, char[] name,
+ *   uint64 road length, char[] road, uint64 #trips,
+ *   int32[7] (id, orig, dest, early, late, load, base cost) per trip,
+ *   uint64 off[#trips+1], Wayp rte[off[#trips]]
+ * Trips are stored sorted by early; trip i's initial route (vehicles only) is
+ * rte[off[i]..off[i+1]). */
+static const char PROBLEM_MAGIC[8] = {'C','A','R','G','O','P','B','1'};
+
+bool is_compiled(const Filepath& path) {
+  std::ifstream ifs(path, std::ios::binary);
+  char magic[8];
+  return ifs.read(magic, sizeof(magic))
+      && std::equal(magic, magic + 8, PROBLEM_MAGIC);
+}
+
+size_t read_compiled(const Filepath& path, const size_t& roadhash,
+                     ProblemSet& probset, vec_t<DistInt>& costs,
+                     vec_t<vec_t<Wayp>>& rtes) {
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs.good()) throw std::runtime_error("problem path not found");
+  auto get = [&ifs](void* data, size_t len) {
+    if (!ifs.read(static_cast<char*>(data), len))
+      throw std::runtime_error("compiled problem truncated");
+  };
+  auto get_string = [&get](std::string& str) {
+    uint64_t len;
+    get(&len, sizeof(len));
+    str.resize(len);
+    if (len > 0) get(&str[0], len);
+  };
+  char magic[8];
+  uint64_t hash, ntrips;
+  get(magic, sizeof(magic));
+  if (!std::equal(magic, magic + 8, PROBLEM_MAGIC))
+    throw std::runtime_error("not a compiled problem");
+  get(&hash, sizeof(hash));
+  get_string(probset.name());
+  get_string(probset.road_network());
+  get(&ntrips, sizeof(ntrips));
+  vec_t<int32_t> rows(7*ntrips);
+  vec_t<uint64_t> off(ntrips + 1);
+  get(rows.data(), rows.size()*sizeof(int32_t));
+  get(off.data(), off.size()*sizeof(uint64_t));
+  vec_t<Wayp> wps(off.back());
+  get(wps.data(), wps.size()*sizeof(Wayp));
+
+  dict<ErlyTime, vec_t<Trip>> trips;
+  for (size_t i = 0; i < ntrips; ++i) {
+    const int32_t* r = &rows[7*i];
+    trips[r[3]].push_back(Trip(r[0], r[1], r[2], r[3], r[4], r[5]));
+  }
+  probset.set_trips(trips);
+
+  // Costs and routes are only valid on the road network they were made for
+  costs.clear();
+  rtes.clear();
+  if (hash == roadhash) {
+    for (size_t i = 0; i < ntrips; ++i) {
+      costs.push_back(rows[7*i+6]);
+      rtes.push_back(vec_t<Wayp>(wps.begin() + off[i], wps.begin() + off[i+1]));
+    }
+  }
+  return ntrips;
+}
+
+void write_compiled(const Filepath& path, const size_t& roadhash,
+                    ProblemSet& probset, const vec_t<Trip>& trips,
+                    const vec_t<DistInt>& costs,
+                    const vec_t<vec_t<Wayp>>& rtes) {
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  if (!ofs.good()) throw std::runtime_error("compiled path not writable");
+  auto put = [&ofs](const void* data, size_t len) {
+    ofs.write(static_cast<const char*>(data), len);
+  };
+  auto put_string = [&put](const std::string& str) {
+    const uint64_t len = str.size();
+    put(&len, sizeof(len));
+    put(str.data(), len);
+  };
+  const uint64_t hash = roadhash, ntrips = trips.size();
+  vec_t<int32_t> rows;
+  vec_t<uint64_t> off = {0};
+  for (size_t i = 0; i < ntrips; ++i) {
+    const Trip& tr = trips.at(i);
+    for (int32_t x : {tr.id(), tr.orig(), tr.dest(), tr.early(), tr.late(),
+                      tr.load(), costs.at(i)})
+      rows.push_back(x);
+    off.push_back(off.back() + rtes.at(i).size());
+  }
+  put(PROBLEM_MAGIC, sizeof(PROBLEM_MAGIC));
+  put(&hash, sizeof(hash));
+  put_string(probset.name());
+  put_string(probset.road_network());
+  put(&ntrips, sizeof(ntrips));
+  put(rows.data(), rows.size()*sizeof(int32_t));
+  put(off.data(), off.size()*sizeof(uint64_t));
+  for (const vec_t<Wayp>& rte : rtes)
+    put(rte.data(), rte.size()*sizeof(Wayp));
+  if (!ofs.good()) throw std::runtime_error("compiled problem write failed");
+}
+
+ProblemStream::ProblemStream()
+    : has_costs_(false), ntrips_(0), nread_(0), nvehicles_(0), ncustomers_(0),
+      off_(0), max_early_(0), max_late_(0), row_() {}
+
+void ProblemStream::open(const Filepath& path, const size_t& roadhash,
+                         ProblemSet& probset) {
+  rows_.open(path, std::ios::binary);
+  if (!rows_.good()) throw std::runtime_error("problem path not found");
+  auto get = [this](void* data, size_t len) {
+    if (!rows_.read(static_cast<char*>(data), len))
+      throw std::runtime_error("compiled problem truncated");
+  };
+  auto get_string = [&get](std::string& str) {
+    uint64_t len;
+    get(&len, sizeof(len));
+    str.resize(len);
+    if (len > 0) get(&str[0], len);
+  };
+  char magic[8];
+  uint64_t hash, ntrips;
+  get(magic, sizeof(magic));
+  if (!std::equal(magic, magic + 8, PROBLEM_MAGIC))
+    throw std::runtime_error("not a compiled problem");
+  get(&hash, sizeof(hash));
+  get_string(probset.name());
+  get_string(probset.road_network());
+  get(&ntrips, sizeof(ntrips));
+  has_costs_ = (hash == roadhash);
+  ntrips_ = ntrips;
+
+  /* Count the trips, one block of rows at a time */
+  const std::streamoff beg = rows_.tellg();
+  vec_t<int32_t> block(7*4096);
+  ids_.clear();
+  ids_.reserve(ntrips_);
+  for (size_t i = 0; i < ntrips_; ) {
+    const size_t n = std::min(ntrips_ - i, block.size()/7);
+    get(block.data(), 7*n*sizeof(int32_t));
+    for (size_t k = 0; k < n; ++k) {
+      const int32_t* r = &block[7*k];
+      if (r[5] < 0) nvehicles_++;
+      if (r[5] > 0) ncustomers_++;
+      max_early_ = std::max(max_early_, (ErlyTime)r[3]);
+      max_late_ = std::max(max_late_, (LateTime)r[4]);
+      ids_.push_back(r[0]);
+    }
+    i += n;
+  }
+
+  /* Position the cursors on the first trip, offset, and route */
+  rows_.seekg(beg);
+  offs_.open(path, std::ios::binary);
+  wayps_.open(path, std::ios::binary);
+  offs_.seekg(beg + (std::streamoff)(7*ntrips_*sizeof(int32_t)));
+  wayps_.seekg(offs_.tellg() + (std::streamoff)((ntrips_+1)*sizeof(uint64_t)));
+  if (!offs_.read(reinterpret_cast<char*>(&off_), sizeof(off_)))
+    throw std::runtime_error("compiled problem truncated");
+  nread_ = 0;
+  if (ntrips_ > 0) get(row_, sizeof(row_));
+}
+
+bool     ProblemStream::is_open()    const { return rows_.is_open(); }
+bool     ProblemStream::has_costs()  const { return has_costs_; }
+size_t   ProblemStream::size()       const { return ntrips_; }
+size_t   ProblemStream::nread()      const { return nread_; }
+size_t   ProblemStream::vehicles()   const { return nvehicles_; }
+size_t   ProblemStream::customers()  const { return ncustomers_; }
+ErlyTime ProblemStream::max_early()  const { return max_early_; }
+LateTime ProblemStream::max_late()   const { return max_late_; }
+const vec_t<TripId>& ProblemStream::ids() const { return ids_; }
+
+bool ProblemStream::peek(ErlyTime& early) const {
+  if (nread_ == ntrips_) return false;
+  early = row_[3];
+  return true;
+}
+
+bool ProblemStream::next(Trip& trip, DistInt& cost, vec_t<Wayp>& rte) {
+  if (nread_ == ntrips_) return false;
+  trip = Trip(row_[0], row_[1], row_[2], row_[3], row_[4], row_[5]);
+  cost = row_[6];
+  uint64_t end;
+  if (!offs_.read(reinterpret_cast<char*>(&end), sizeof(end)))
+    throw std::runtime_error("compiled problem truncated");
+  rte.resize(end - off_);
+  if (!wayps_.read(reinterpret_cast<char*>(rte.data()), rte.size()*sizeof(Wayp)))
+    throw std::runtime_error("compiled problem truncated");
+  off_ = end;
+  if (!has_costs_) {
+    cost = 0;
+    rte.clear();
+  }
+  if (++nread_ < ntrips_ &&
+      !rows_.read(reinterpret_cast<char*>(row_), sizeof(row_)))
+    throw std::runtime_error("compiled problem truncated");
+  return true;
+}
 
-Logger::Logger(const Filepath& f_out) : file_output_(f_out, std::ios::out) {
+Logger::Logger(const Filepath& f_out, bool append)
+    : file_output_(f_out, append ? std::ios::app : std::ios::out) {
   done_ = false;
 }
 
@@ -243,9 +830,11 @@ void Logger::put_q_message(const int& q) {
 }
 
 void Logger::push(std::string item) {
-  std::unique_lock<std::mutex> lock(mutex_);
-  queue_.push(item);
-  condition_.notify_one();
+  Logger* logger = Cargo::ctx().logger;
+  if (logger == nullptr) return;  // simulation not running
+  std::unique_lock<std::mutex> lock(logger->mutex_);
+  logger->queue_.push(item);
+  logger->condition_.notify_one();
 }
 
 std::string Logger::pop() {
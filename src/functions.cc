@@ -75,8 +75,12 @@ DistInt pickup_range(const Customer& cust) {
 
 
 /* Route operations ----------------------------------------------------------*/
-DistInt route_through(
-    const vec_t<Stop>   & sch,
+/* Route through loc(0), ..., loc(n-1); shared by route_through and the
+ * insertion kernel, which permutes bare locations instead of Stops */
+template <typename LocFn>
+static DistInt route_along(
+    const size_t        & n,
+          LocFn           loc,
           vec_t<Wayp>   & rteout,
           GTree::G_Tree & gtree,
     const bool          & count)
@@ -84,14 +88,14 @@ DistInt route_through(
   DistInt cost = 0;
   DistInt traveled = 0;
   rteout.clear();
-  Wayp wp = std::make_pair(cost, sch.front().loc());
+  Wayp wp = std::make_pair(cost, loc(0));
   // std::cout << "route_through push_back " << wp << std::endl;
   rteout.push_back(wp);
 
   vec_t<Wayp> path = {};
-  for (auto i = sch.cbegin(); i != sch.cend() - 1; ++i) {
-    const NodeId& from = i->loc();
-    const NodeId& to = (std::next(i,1))->loc();
+  for (size_t i = 0; i < n - 1; ++i) {
+    const NodeId& from = loc(i);
+    const NodeId& to = loc(i+1);
     path = {};
     // std::cout << from << ">" << to << std::endl;
     //if (from != to) {
@@ -111,6 +115,16 @@ DistInt route_through(
   return traveled;
 }
 
+DistInt route_through(
+    const vec_t<Stop>   & sch,
+          vec_t<Wayp>   & rteout,
+          GTree::G_Tree & gtree,
+    const bool          & count)
+{
+  return route_along(sch.size(), [&](const size_t& i) -> const NodeId& {
+      return sch[i].loc(); }, rteout, gtree, count);
+}
+
 DistInt route_through(const vec_t<Stop>& sch, vec_t<Wayp>& rteout, const bool& count) {
   return route_through(sch, rteout, Cargo::gtree(), count);
 }
@@ -324,20 +338,37 @@ DistInt sop_insert(const vec_t<Stop>& sch, const Stop& orig,
   schout.clear();
   rteout.clear();
 
-  vec_t<Stop> mutsch = sch;   // mutable schedule
+  vec_t<Stop> stops = sch;    // the stops, in their initial order
+  stops.insert(stops.begin() + fix_start, orig);
+  stops.insert(stops.begin() + fix_start, dest);
+
+  /* The permutations only need the locations; permute these and the stop
+   * indices (struct-of-arrays) instead of the Stops, and build the best
+   * schedule once at the end */
+  const int n = stops.size();
+  vec_t<NodeId> locs(n);      // mutable schedule (locations)
+  vec_t<SchIdx> perm(n);      // mutable schedule (indices into stops)
+  for (int k = 0; k < n; ++k) {
+    locs[k] = stops[k].loc();
+    perm[k] = k;
+  }
+  vec_t<SchIdx> best;
   vec_t<Wayp> mutrte;         // mutable route
 
-  auto check = [&](DistInt cst) {
+  auto swap = [&](const int& a, const int& b) {
+    std::swap(locs[a], locs[b]);
+    std::swap(perm[a], perm[b]);
+  };
+  auto check = [&]() {
+    DistInt cst = route_along(n, [&](const size_t& k) -> const NodeId& {
+        return locs[k]; }, mutrte, gtree, true);
     if (cst <= mincst) {
       mincst = cst;
-      schout = mutsch;
-      rteout = mutrte;
+      best = perm;
+      std::swap(rteout, mutrte);  // mutrte is overwritten by the next route
     }
   };
 
-  mutsch.insert(mutsch.begin() + fix_start, orig);
-  mutsch.insert(mutsch.begin() + fix_start, dest);
-
   // This algorithm uses a series of swaps to generate all insertion
   // combinations.  Here is an example of inserting stops (A, B) into a
   // 3-stop sched:
@@ -351,32 +382,28 @@ DistInt sop_insert(const vec_t<Stop>& sch, const Stop& orig,
   // - - A B -
   // - - A - B
   // - - - A B
+  const int last = n - 1 - fix_end;
   int inc = 1;
   bool rst = false;
-  vec_t<Stop>::iterator beg, end;
-  for (auto i = mutsch.begin() + fix_start; i != mutsch.end() - 1 - fix_end;
-       ++i) {
-    beg = (inc == 1) ? i : mutsch.end() - 1 - fix_end;
-    end = (inc == 1) ? mutsch.end() - 1 - fix_end : i + 1;
-    for (auto j = beg; j != end; j += inc) {
+  for (int i = fix_start; i != last; ++i) {
+    const int beg = (inc == 1) ? i : last;
+    const int end = (inc == 1) ? last : i + 1;
+    for (int j = beg; j != end; j += inc) {
       if (rst) {
-        std::iter_swap(i - 1, i + 1);
+        swap(i - 1, i + 1);
         rst = false;
       } else
-        std::iter_swap(j, j + inc);
-      //check(cost_through(mutsch, gtree));
-      check(route_through(mutsch, mutrte, gtree));
-    }
-    std::iter_swap(i, i + 1);
-    if (inc == 1 && i < mutsch.end() - 2 - fix_end) {
-      //check(cost_through(mutsch, gtree));
-      check(route_through(mutsch, mutrte, gtree));
+        swap(j, j + inc);
+      check();
     }
+    swap(i, i + 1);
+    if (inc == 1 && i < last - 1)
+      check();
     if ((inc = -inc) == 1) rst = true;
   }
 
-  // After got the best, THEN resolve the full route
-  //route_through(schout, rteout, gtree);
+  for (const SchIdx& k : best)
+    schout.push_back(stops[k]);
 
   return mincst;
 }
@@ -396,10 +423,10 @@ DistInt cost_through(const vec_t<Stop>& sch, GTree::G_Tree& gtree) {
           std::cout << "index: " << i << std::endl;
           throw;
         }
-        std::lock_guard<std::mutex> sclock(Cargo::scmx); // Lock acquired
+        std::lock_guard<std::mutex> sclock(Cargo::scmx()); // Lock acquired
         Cargo::scput(from, to, cst);
       } else {
-        std::lock_guard<std::mutex> sclock(Cargo::spmx); // Lock acquired
+        std::lock_guard<std::mutex> sclock(Cargo::spmx()); // Lock acquired
         cst += Cargo::scget(from, to);
       }
     } else
@@ -503,7 +530,7 @@ DistInt sop_replace(const MutableVehicle& mutvehl,
   MutableVehicle mutcopy = mutvehl;
   vec_t<Stop> sch1 = mutcopy.schedule().data();
   opdel(sch1, rm);
-  mutcopy.set_sch(sch1);
+  mutcopy.set_sch(std::move(sch1));
   return sop_insert(mutcopy, cust, schout, rteout);
 }
 
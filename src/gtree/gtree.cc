@@ -15,7 +15,6 @@ Wide_KNN_           Wide_KNN;
 G_Tree              tree;
 Graph               G;
 
-std::mutex G_Tree::gtmx;
 
 G_Tree get() {
     return tree;
@@ -1261,7 +1260,7 @@ void G_Tree::push_borders_up(int x, std::vector<int> &dist1, int type) {
             dist2[node[x].border_in_father[i]] = dist1[i];
     // printf("dist2:");save_vector(dist2);
     //int **dist = node[y].dist.a;
-    std::vector<std::vector<int>> dist = node[y].dist.a;
+    const std::vector<std::vector<int>> &dist = node[y].dist.a;
     // vector<int>begin,end;
     int *begin, *end;
     begin = new int[node[x].borders.size()];
@@ -1485,12 +1484,13 @@ void G_Tree::push_borders_brother_catch(int x, int y, int bound) {
                 std::min(node[y].min_border_dist, node[y].catch_dist[i]);
 }
 
-void G_Tree::push_borders_up_path(int x, std::vector<int> &dist1) {
+void G_Tree::push_borders_up_path(int x, std::vector<int> &dist1,
+                                  std::vector<int> &record) {
     if (node[x].father == 0)
         return;
     int y = node[x].father;
     std::vector<int> dist3(node[y].borders.size(), INF);
-    std::vector<int> *order = &node[y].path_record;
+    std::vector<int> *order = &record;
     (*order).clear();
     for (int i = 0; i < (int)node[y].borders.size(); i++)
         (*order).push_back(-INF);
@@ -1501,7 +1501,7 @@ void G_Tree::push_borders_up_path(int x, std::vector<int> &dist1) {
         }
     // printf("dist3:");save_vector(dist3);
     //int **dist = node[y].dist.a;
-    auto dist = node[y].dist.a;
+    const auto &dist = node[y].dist.a;
     // vector<int>begin,end;
     int *begin, *end;
     begin = new int[node[x].borders.size()];
@@ -1540,7 +1540,6 @@ int G_Tree::find_LCA(int x, int y) {
 }
 
 int G_Tree::search(int S, int T) {
-    std::lock_guard<std::mutex> gtlock(gtmx);  // Lock acquired
     if (S == T)
         return 0;
 
@@ -1651,7 +1650,6 @@ int G_Tree::search_catch(int S, int T, int bound) {
 }
 
 int G_Tree::find_path(int S, int T, std::vector<int> &order) {
-    std::lock_guard<std::mutex> gtlock(gtmx);  // Lock acquired
     order.clear();
     if (S == T) {
         order.push_back(S);
@@ -1672,14 +1670,17 @@ int G_Tree::find_path(int S, int T, std::vector<int> &order) {
     std::vector<int> dist[2], dist_;
     dist[0].push_back(0);
     dist[1].push_back(0);
+    // Path records of the nodes visited by this query (kept local, instead of
+    // in node[].path_record, so concurrent queries do not clobber each other)
+    std::map<int, std::vector<int>> record;
     x = id_in_node[S], y = id_in_node[T];
     // printf("LCA=%d x=%d y=%d\n",LCA,x,y);
     while (node[x].father != LCA) {
-        push_borders_up_path(x, dist[0]);
+        push_borders_up_path(x, dist[0], record[node[x].father]);
         x = node[x].father;
     }
     while (node[y].father != LCA) {
-        push_borders_up_path(y, dist[1]);
+        push_borders_up_path(y, dist[1], record[node[y].father]);
         y = node[y].father;
     }
     std::vector<int> id[2];
@@ -1719,15 +1720,16 @@ int G_Tree::find_path(int S, int T, std::vector<int> &order) {
                 p = y, now = node[LCA].border_in_son[T_];
             while (node[p].n > 1) {
                 // printf("t=%d p=%d now=%d
-                // node[p].path_record[now]=%d\n",t,p,now,node[p].path_record[now]);
-                if (node[p].path_record[now] >= 0) {
-                    find_path_border(p, now, node[p].path_record[now],
+                // record[p][now]=%d\n",t,p,now,record[p][now]);
+                const std::vector<int> &path_record = record.at(p);
+                if (path_record[now] >= 0) {
+                    find_path_border(p, now, path_record[now],
                                      order, 0);
-                    now = node[p].path_record[now];
-                } else if (node[p].path_record[now] > -INF) {
+                    now = path_record[now];
+                } else if (path_record[now] > -INF) {
                     int temp = now;
                     now = node[p].border_in_son[now];
-                    p = -node[p].path_record[temp];
+                    p = -path_record[temp];
                 } else
                     break;
             }
@@ -23,6 +23,7 @@
 #include <chrono>
 #include <cmath>
 #include <iterator> /* std::back_inserter */
+#include <limits>
 #include <mutex>
 #include <numeric>
 #include <thread>
@@ -31,9 +32,11 @@
 #include "libcargo/classes.h"
 #include "libcargo/debug.h"
 #include "libcargo/dbsql.h"
+#include "libcargo/events.h"
 #include "libcargo/file.h"
 #include "libcargo/message.h"
 #include "libcargo/rsalgorithm.h"
+#include "libcargo/segments.h"
 #include "libcargo/types.h"
 
 namespace cargo {
@@ -48,19 +51,21 @@ RSAlgorithm::RSAlgorithm(const std::string& name, bool fifo)
   this->delay_ = {};
   this->retry_ = 0;
   this->timeout_ = 1;
+  this->live_ = false;
+  this->want_ = false;
   prepare_stmt(sql::ssr_stmt, &ssr_stmt);
   prepare_stmt(sql::sss_stmt, &sss_stmt);
   prepare_stmt(sql::uro_stmt, &uro_stmt);
   prepare_stmt(sql::sch_stmt, &sch_stmt);
   prepare_stmt(sql::qud_stmt, &qud_stmt);
   prepare_stmt(sql::com_stmt, &com_stmt);
-  prepare_stmt(sql::smv_stmt, &smv_stmt);
   prepare_stmt(sql::sac_stmt, &sac_stmt);
   prepare_stmt(sql::sav_stmt, &sav_stmt);
   prepare_stmt(sql::svs_stmt, &svs_stmt);
-  prepare_stmt(sql::swc_stmt, &swc_stmt);
   prepare_stmt(sql::sov_stmt, &sov_stmt);
-  prepare_stmt(sql::sva_stmt, &sva_stmt);
+  prepare_stmt(sql::sca_stmt, &sca_stmt);
+  prepare_stmt(sql::sve_stmt, &sve_stmt);
+  prepare_stmt(sql::upk_stmt, &upk_stmt);
 }
 
 RSAlgorithm::~RSAlgorithm() {
@@ -70,13 +75,13 @@ RSAlgorithm::~RSAlgorithm() {
   sqlite3_finalize(sch_stmt);
   sqlite3_finalize(qud_stmt);
   sqlite3_finalize(com_stmt);
-  sqlite3_finalize(smv_stmt);
-  sqlite3_finalize(swc_stmt);
   sqlite3_finalize(sac_stmt);
   sqlite3_finalize(sav_stmt);
   sqlite3_finalize(svs_stmt);
   sqlite3_finalize(sov_stmt);
-  sqlite3_finalize(sva_stmt);
+  sqlite3_finalize(sca_stmt);
+  sqlite3_finalize(sve_stmt);
+  sqlite3_finalize(upk_stmt);
 }
 
 const bool        & RSAlgorithm::done()                     const { return done_; }
@@ -122,55 +127,144 @@ bool RSAlgorithm::assign(
 //      bool                strict) {
   //if (custs_to_add.empty() && custs_to_del.empty())
   //  return true;
-  bool strict = Cargo::strict_mode;
-  std::lock_guard<std::mutex> dblock(Cargo::dbmx);
+  /* Snapshot the vehicle, plan against the snapshot without holding the
+   * lock (re-routing computes shortest paths), then commit if the vehicle's
+   * version has not changed in the meantime; otherwise plan again */
+  VehlState snap;
+  vec_t<Wayp> out_rte;
+  vec_t<Stop> out_sch;
+  { std::lock_guard<std::mutex> dblock(Cargo::dbmx());
+    if (!read_vehl(vehl.id(), custs_to_add, custs_to_del, snap)) {
+      this->nrej_++;
+      return false;
+    }
+  }
+  for (int tries = 1; ; ++tries) {
+    bool planned = plan(snap, custs_to_add, new_rte, new_sch,
+                        vehl, out_rte, out_sch);
+    std::lock_guard<std::mutex> dblock(Cargo::dbmx());
+    bool current = false;
+    if (!check_version(vehl.id(), custs_to_add, custs_to_del, snap, current)) {
+      this->nrej_++;
+      return false;
+    }
+    if (!current) {
+      /* Still moving after max_tries_ plans; re-planning here would route
+       * with dbmx held, so reject and let the algorithm try again */
+      if (tries >= max_tries_
+       || !read_vehl(vehl.id(), custs_to_add, custs_to_del, snap)) {
+        this->nrej_++;
+        return false;
+      }
+      DEBUG(3, { print << "assign() vehicle moved; re-planning" << std::endl; });
+      continue;
+    }
+    if (!planned) {
+      this->nrej_++;
+      return false;
+    }
+    if (!apply(snap, custs_to_add, custs_to_del, out_rte, out_sch, vehl))
+      return false;
+    note_assigned(custs_to_add, custs_to_del, vehl.id());
+    return true;
+  }
+}
 
+bool RSAlgorithm::read_vehl(const VehlId& vehl_id,
+                            const vec_t<CustId>& cadd,
+                            const vec_t<CustId>& cdel, VehlState& state) {
   /* Get current vehicle properties */
   sqlite3_clear_bindings(sov_stmt);
   sqlite3_reset(sov_stmt);
-  sqlite3_bind_int(sov_stmt, 1, vehl.id());
+  sqlite3_bind_int(sov_stmt, 1, vehl_id);
   if (sqlite3_step(sov_stmt) != SQLITE_ROW) {
-    vehl.print();
-    throw std::runtime_error("sov_stmt returned no rows.");
+    /* Arrived vehicles are retired from the database */
+    sqlite3_reset(sov_stmt);
+    return false;
   }
 
   /* Check status */
   if (static_cast<VehlStatus>(sqlite3_column_int(sov_stmt, 7))
           == VehlStatus::Arrived) {
-    this->nrej_++;
+    sqlite3_reset(sov_stmt);
     return false;
   }
 
   /* Get current capacity */
-  const int curcap = sqlite3_column_int(sov_stmt, 5)*(-1);
+  state.curcap = sqlite3_column_int(sov_stmt, 5)*(-1);
 
   /* Get current schedule */
   const Stop* schbuf =
     static_cast<const Stop*>(sqlite3_column_blob(sov_stmt, 11));
-  vec_t<Stop> cur_sch(
+  state.sch.assign(
     schbuf, schbuf + sqlite3_column_bytes(sov_stmt, 11) / sizeof(Stop));
 
   /* Get current route */
-  const Wayp* rtebuf
-    = static_cast<const Wayp*>(sqlite3_column_blob(sov_stmt, 8));
-  vec_t<Wayp> cur_rte(
-    rtebuf, rtebuf + sqlite3_column_bytes(sov_stmt, 8) / sizeof(Wayp));
-  RteIdx  cur_lvn = sqlite3_column_int(sov_stmt, 9);
-  DistInt cur_nnd = sqlite3_column_int(sov_stmt, 10);
-
-  if (sqlite3_step(sov_stmt) != SQLITE_DONE) {
-    vehl.print();
+  PackedRoute(Cargo::segments(), sqlite3_column_blob(sov_stmt, 8),
+              sqlite3_column_bytes(sov_stmt, 8)).unpack(state.rte);
+  state.lvn = sqlite3_column_int(sov_stmt, 9);
+  state.nnd = sqlite3_column_int(sov_stmt, 10);
+  state.version = sqlite3_column_int(sov_stmt, 12);
+
+  if (sqlite3_step(sov_stmt) != SQLITE_DONE)
     throw std::runtime_error("sov_stmt returned multiple rows.");
+  sqlite3_reset(sov_stmt);
+
+  /* Customer stops are read here, with the vehicle, and not by sync() */
+  state.visited = check_visited(cadd, cdel);
+  return true;
+}
+
+bool RSAlgorithm::check_version(const VehlId& vehl_id,
+                                const vec_t<CustId>& cadd,
+                                const vec_t<CustId>& cdel,
+                                VehlState& state, bool& current) {
+  /* The version changes whenever the vehicle's route, schedule, load or
+   * status does; the distance to the next node changes every step without
+   * affecting a plan, so it is only refreshed */
+  sqlite3_bind_int(sve_stmt, 1, vehl_id);
+  if (sqlite3_step(sve_stmt) != SQLITE_ROW
+   || static_cast<VehlStatus>(sqlite3_column_int(sve_stmt, 2))
+          == VehlStatus::Arrived) {
+    sqlite3_clear_bindings(sve_stmt);
+    sqlite3_reset(sve_stmt);
+    return false;
   }
+  const Version version = sqlite3_column_int(sve_stmt, 0);
+  const DistInt nnd = sqlite3_column_int(sve_stmt, 1);
+  sqlite3_clear_bindings(sve_stmt);
+  sqlite3_reset(sve_stmt);
+  current = (version == state.version
+          && check_visited(cadd, cdel) == state.visited);
+  if (current) state.nnd = nnd;
+  return true;
+}
+
+bool RSAlgorithm::plan(
+  const VehlState     & cur,
+  const vec_t<CustId> & custs_to_add,
+  const vec_t<Wayp>   & new_rte,
+  const vec_t<Stop>   & new_sch,
+  const MutableVehicle & vehl,
+        vec_t<Wayp>   & out_rte,
+        vec_t<Stop>   & out_sch) {
+  bool strict = Cargo::strict_mode();
+  const int& curcap = cur.curcap;
+  const vec_t<Wayp>& cur_rte = cur.rte;
+  const vec_t<Stop>& cur_sch = cur.sch;
+  const RteIdx& cur_lvn = cur.lvn;
 
   /* Attempt synchronization */
-  vec_t<CustId> cdel = custs_to_del;
   vec_t<CustId> cadd = custs_to_add;
-  vec_t<Wayp> out_rte {};  // container for synced route
-  vec_t<Stop> out_sch {};  // container for synced schedule
+  out_rte = {};  // container for synced route
+  out_sch = {};  // container for synced schedule
 
+  /* If the vehicle is the version the algorithm read, its route cannot have
+   * diverged from the one the new route was built on */
+  const bool fresh = (vehl.version() == cur.version);
   SyncResult synced = sync(
-    new_rte, cur_rte, cur_lvn, new_sch, cur_sch, cadd, cdel, out_rte, out_sch);
+    new_rte, cur_rte, cur_lvn, new_sch, cur_sch, cadd, cur.visited, fresh,
+    out_rte, out_sch);
   if (synced == SUCCESS) {
     DEBUG(3, { print(MessageType::Info) << "sync succeeded." << std::endl; });
   } else {
@@ -178,14 +272,12 @@ bool RSAlgorithm::assign(
       DEBUG(3, {
         print(MessageType::Error)
           << "assign() strict enabled; done." << std::endl; });
-      this->nrej_++;
       return false;
     }
     if (synced == CDEL_SYNC_FAIL) {
       DEBUG(3, {
         print(MessageType::Error) << "assign() failed due to cdel-sync."
         << std::endl; });
-      this->nrej_++;
       return false;
     }
     DEBUG(3, {
@@ -226,7 +318,6 @@ bool RSAlgorithm::assign(
         print(MessageType::Error)
           << "assign() re_sch failed capacity check"
           << std::endl; });
-      this->nrej_++;
       return false;
     }
 
@@ -246,7 +337,6 @@ bool RSAlgorithm::assign(
         print(MessageType::Error)
           << "assign() re-route failed due to time window"
           << std::endl; });
-      this->nrej_++;
       return false;
     }
 
@@ -265,11 +355,38 @@ bool RSAlgorithm::assign(
    * to db. It checks in the case of re-route, but when there is no re-route,
    * it incorrectly skips the check. */
 
+  return true;
+}
+
+bool RSAlgorithm::apply(
+  const VehlState     & cur,
+  const vec_t<CustId> & custs_to_add,
+  const vec_t<CustId> & custs_to_del,
+  const vec_t<Wayp>   & out_rte,
+  const vec_t<Stop>   & out_sch,
+        MutableVehicle      & vehl) {
+  const DistInt& cur_nnd = cur.nnd;
+  const vec_t<CustId>& cadd = custs_to_add;
+  const vec_t<CustId>& cdel = custs_to_del;
+
+  /* Customers may have been retired since they were checked */
+  for (const auto& cust_id : custs_to_add) {
+    sqlite3_bind_int(sca_stmt, 1, cust_id);
+    bool found = (sqlite3_step(sca_stmt) == SQLITE_ROW);
+    sqlite3_clear_bindings(sca_stmt);
+    sqlite3_reset(sca_stmt);
+    if (!found) {
+      this->nrej_++;
+      return false;
+    }
+  }
+
   /* Output synchronized vehicle */
   vehl.set_rte(out_rte);
   vehl.set_nnd(cur_nnd);
   vehl.set_sch(out_sch);
   vehl.reset_lvn();
+  vehl.set_version(cur.version + 1);  // uro_stmt bumps it
   vehl.incr_queued();
   for (size_t i = 0; i < cadd.size(); ++i) {
     vehl.incr_queued();
@@ -281,8 +398,10 @@ bool RSAlgorithm::assign(
   }
 
   /* Commit the synchronized route */
-  sqlite3_bind_blob(uro_stmt, 1, static_cast<void const*>(out_rte.data()),
-                    out_rte.size() * sizeof(Wayp), SQLITE_TRANSIENT);
+  vec_t<RteRun> runs;
+  Cargo::segments().pack(out_rte, out_sch, runs);
+  sqlite3_bind_blob(uro_stmt, 1, static_cast<void const*>(runs.data()),
+                    runs.size() * sizeof(RteRun), SQLITE_TRANSIENT);
   sqlite3_bind_int(uro_stmt, 2, 0);
   sqlite3_bind_int(uro_stmt, 3, cur_nnd);
   sqlite3_bind_int(uro_stmt, 4, vehl.id());
@@ -293,6 +412,17 @@ bool RSAlgorithm::assign(
   sqlite3_clear_bindings(uro_stmt);
   sqlite3_reset(uro_stmt);
 
+  /* Unpark (no-op unless the vehicle is an idle taxi) */
+  sqlite3_bind_int(upk_stmt, 1, (int)VehlStatus::Enroute);
+  sqlite3_bind_int(upk_stmt, 2, vehl.id());
+  sqlite3_bind_int(upk_stmt, 3, (int)VehlStatus::Parked);
+  if ((rc = sqlite3_step(upk_stmt)) != SQLITE_DONE) {
+    print << "Error in unpark " << rc << std::endl;
+    throw std::runtime_error(sqlite3_errmsg(Cargo::db()));
+  }
+  sqlite3_clear_bindings(upk_stmt);
+  sqlite3_reset(upk_stmt);
+
   /* Commit the synchronized schedule */
   sqlite3_bind_blob(sch_stmt, 1, static_cast<void const*>(out_sch.data()),
                     out_sch.size() * sizeof(Stop), SQLITE_TRANSIENT);
@@ -314,6 +444,24 @@ bool RSAlgorithm::assign(
   sqlite3_clear_bindings(qud_stmt);
   sqlite3_reset(qud_stmt);
 
+  /* Keep the waiting count up to date; an un-assigned customer has to be
+   * timed out again if it is not re-matched within its matching period */
+  auto waiting = [&](const CustId& cust_id, ErlyTime& early) {
+    bool res = false;
+    sqlite3_bind_int(sca_stmt, 1, cust_id);
+    if (sqlite3_step(sca_stmt) == SQLITE_ROW) {
+      res = (sqlite3_column_type(sca_stmt, 0) == SQLITE_NULL &&
+             sqlite3_column_int(sca_stmt, 1) == (int)CustStatus::Waiting);
+      early = sqlite3_column_int(sca_stmt, 2);
+    }
+    sqlite3_clear_bindings(sca_stmt);
+    sqlite3_reset(sca_stmt);
+    return res;
+  };
+  ErlyTime early;
+  for (const auto& cust_id : custs_to_add)
+    if (waiting(cust_id, early)) Cargo::waiting()--;
+
   /* Commit the assignment */
   for (const auto& cust_id : custs_to_add) {
     sqlite3_bind_int(com_stmt, 1, vehl.id());
@@ -336,6 +484,10 @@ bool RSAlgorithm::assign(
     }
     sqlite3_clear_bindings(com_stmt);
     sqlite3_reset(com_stmt);
+    if (waiting(cust_id, early)) {
+      Cargo::waiting()++;
+      Cargo::expire(cust_id, early);
+    }
   }
 
   /* Log the route and match events */
@@ -367,17 +519,135 @@ bool RSAlgorithm::assign_or_delay(
     return success;
 }
 
+std::future<bool> RSAlgorithm::assign_later(
+  const vec_t<CustId> & custs_to_add,
+  const vec_t<CustId> & custs_to_del,
+  const vec_t<Wayp>   & new_rte,
+  const vec_t<Stop>   & new_sch,
+  const MutableVehicle & vehl,
+  std::function<void(bool, MutableVehicle &)> callback) {
+  QueuedAssignSptr qa = std::make_shared<QueuedAssign>();
+  qa->cadd = custs_to_add;
+  qa->cdel = custs_to_del;
+  qa->rte = new_rte;
+  qa->sch = new_sch;
+  qa->vehl = vehl;
+  qa->result = false;
+  qa->callback = callback;
+
+  /* Plan now, on the caller's thread, so that commit_queued() (inside the
+   * simulation step) only has to check and apply */
+  { std::lock_guard<std::mutex> dblock(Cargo::dbmx());
+    qa->planned = read_vehl(vehl.id(), custs_to_add, custs_to_del, qa->state);
+  }
+  if (qa->planned)
+    qa->planned = plan(qa->state, custs_to_add, new_rte, new_sch,
+                       qa->vehl, qa->out_rte, qa->out_sch);
+  std::future<bool> res = qa->promise.get_future();
+  std::lock_guard<std::mutex> qlock(qmx_);
+  queued_.push_back(qa);
+  return res;
+}
+
+void RSAlgorithm::commit_queued() {
+  vec_t<QueuedAssignSptr> batch;
+  { std::lock_guard<std::mutex> qlock(qmx_);
+    batch.swap(queued_);
+  }
+  if (batch.empty()) return;
+
+  /* Validate and apply in the order queued, all in one transaction */
+  { std::lock_guard<std::mutex> dblock(Cargo::dbmx());
+    char* err;
+    sqlite3_exec(Cargo::db(), "BEGIN", NULL, NULL, &err);
+    for (const QueuedAssignSptr& qa : batch)
+      qa->result = commit_planned(*qa);
+    sqlite3_exec(Cargo::db(), "END", NULL, NULL, &err);
+  }
+
+  /* Hand back the results after the transaction is done; the algorithm's
+   * own state (waiting_, callbacks) is updated on its thread */
+  std::lock_guard<std::mutex> qlock(qmx_);
+  for (const QueuedAssignSptr& qa : batch) {
+    qa->promise.set_value(qa->result);
+    committed_.push_back(qa);
+  }
+}
+
+bool RSAlgorithm::commit_planned(QueuedAssign& qa) {
+  /* A plan made on a vehicle that has changed since (e.g. by an earlier
+   * assignment in the same batch) is rejected, never re-planned here */
+  bool current = false;
+  if (!qa.planned
+   || !check_version(qa.vehl.id(), qa.cadd, qa.cdel, qa.state, current)
+   || !current) {
+    this->nrej_++;
+    return false;
+  }
+  return apply(qa.state, qa.cadd, qa.cdel, qa.out_rte, qa.out_sch, qa.vehl);
+}
+
+void RSAlgorithm::run_callbacks() {
+  vec_t<QueuedAssignSptr> done;
+  { std::lock_guard<std::mutex> qlock(qmx_);
+    done.swap(committed_);
+  }
+  for (const QueuedAssignSptr& qa : done) {
+    if (qa->result) note_assigned(qa->cadd, qa->cdel, qa->vehl.id());
+    if (qa->callback) qa->callback(qa->result, qa->vehl);
+  }
+}
+
+void RSAlgorithm::note_assigned(const vec_t<CustId>& cadd,
+                                const vec_t<CustId>& cdel,
+                                const VehlId& vehl_id) {
+  /* Record the (un-)assignments in the waiting customers */
+  auto set_assigned = [&](const CustId& cust_id, const VehlId& assigned) {
+    auto it = waiting_.find(cust_id);
+    if (it == waiting_.end()) return;
+    const Customer& c = it->second;
+    it->second = Customer(c.id(), c.orig(), c.dest(), c.early(), c.late(),
+                          c.load(), c.status(), assigned);
+  };
+  for (const auto& cust_id : cadd) set_assigned(cust_id, vehl_id);
+  for (const auto& cust_id : cdel) set_assigned(cust_id, 0);
+}
+
+/* Customers not under delay have the earliest possible start, so that the
+ * check needs no separate "is delayed" flag */
+static const SimlTime NO_DELAY = std::numeric_limits<SimlTime>::min();
+
 bool RSAlgorithm::delay(const CustId& cust_id) {
-  return (delay_.count(cust_id) && delay_.at(cust_id) >= Cargo::now() - retry_)
-    ? true : false;
+  const size_t k = Cargo::tidx(cust_id);
+  std::lock_guard<std::mutex> lock(dlmx_);
+  return (k < delay_.size() && delay_[k] >= Cargo::now() - retry_);
 }
 
 void RSAlgorithm::beg_delay(const CustId& cust_id) {
-  delay_[cust_id] = Cargo::now();
+  std::lock_guard<std::mutex> lock(dlmx_);
+  if (delay_.size() != Cargo::ntrips()) delay_.resize(Cargo::ntrips(), NO_DELAY);
+  delay_.at(Cargo::tidx(cust_id)) = Cargo::now();
 }
 
 void RSAlgorithm::end_delay(const CustId& cust_id) {
-  if (delay_.count(cust_id)) delay_.erase(cust_id);
+  const size_t k = Cargo::tidx(cust_id);
+  std::lock_guard<std::mutex> lock(dlmx_);
+  if (k < delay_.size()) delay_[k] = NO_DELAY;
+}
+
+void RSAlgorithm::get_state(int& nmat, int& nrej, vec_t<SimlTime>& delays) {
+  std::lock_guard<std::mutex> lock(dlmx_);
+  nmat = nmat_;
+  nrej = nrej_;
+  delays = delay_;
+}
+
+void RSAlgorithm::set_state(const int& nmat, const int& nrej,
+                            const vec_t<SimlTime>& delays) {
+  std::lock_guard<std::mutex> lock(dlmx_);
+  nmat_ = nmat;
+  nrej_ = nrej;
+  delay_ = delays;
 }
 
 bool RSAlgorithm::timeout(const tick_t& start) {
@@ -414,6 +684,23 @@ void RSAlgorithm::print_sch(const vec_t<Stop>& sch) {
   print << std::endl;
 }
 
+RSAlgorithm::SyncResult
+RSAlgorithm::check_visited(const vec_t<CustId> & cadd,
+                           const vec_t<CustId> & cdel) {
+  /* VALIDATE CUSTOMERS
+   * If a customer was retired, or any of its stops are visited already,
+   * sync fails (Cargo keeps the visited stops in memory). Timed-out
+   * customers are retired to Absent, so they fail here too.
+   */
+  for (const CustId& cid : cadd)
+    if (Cargo::visited(cid) != StopsVisited::None)
+      return CADD_SYNC_FAIL;
+  for (const CustId& cid : cdel)
+    if (Cargo::visited(cid) != StopsVisited::None)
+      return CDEL_SYNC_FAIL;
+  return SUCCESS;
+}
+
 RSAlgorithm::SyncResult
 RSAlgorithm::sync(const vec_t<Wayp>   & new_rte,
                   const vec_t<Wayp>   & cur_rte,
@@ -421,7 +708,8 @@ RSAlgorithm::sync(const vec_t<Wayp>   & new_rte,
                   const vec_t<Stop>   & new_sch,
                   const vec_t<Stop>   & cur_sch,
                   const vec_t<CustId> & cadd,
-                  const vec_t<CustId> & cdel,
+                  const SyncResult    & visited,
+                  const bool          & fresh,
                         vec_t<Wayp>   & out_rte,
                         vec_t<Stop>   & out_sch) {
   // HACKY BUT WORKS -- ALWAYS RETURN TRUE IF:
@@ -445,70 +733,9 @@ RSAlgorithm::sync(const vec_t<Wayp>   & new_rte,
     print << "sync(9) got cur_sch: "; print_sch(cur_sch);
   });
 
-  /* VALIDATE CUSTOMERS
-   * If any customer stops are visited already, sync fails
-   * TODO: If customer already timed out, sync fails
-   */
-  for (const CustId& cid : cadd) {
-    sqlite3_bind_int(sva_stmt, 1, cid);
-    sqlite3_bind_int(sva_stmt, 2, (int)StopType::CustOrig);
-    if (sqlite3_step(sva_stmt) != SQLITE_ROW) {
-      print(MessageType::Error) << "sva_stmt failed" << std::endl;
-      throw;
-    }
-    if (sqlite3_step(sva_stmt) != SQLITE_DONE) {
-      print(MessageType::Error) << "sva_stmt multiple rows" << std::endl;
-      throw;
-    }
-    if (sqlite3_column_int(sva_stmt, 0) == -1)
-      return CADD_SYNC_FAIL;
-    sqlite3_clear_bindings(sva_stmt);
-    sqlite3_reset(sva_stmt);
-    sqlite3_bind_int(sva_stmt, 1, cid);
-    sqlite3_bind_int(sva_stmt, 2, (int)StopType::CustDest);
-    if (sqlite3_step(sva_stmt) != SQLITE_ROW) {
-      print(MessageType::Error) << "sva_stmt failed" << std::endl;
-      throw;
-    }
-    if (sqlite3_step(sva_stmt) != SQLITE_DONE) {
-      print(MessageType::Error) << "sva_stmt multiple rows" << std::endl;
-      throw;
-    }
-    if (sqlite3_column_int(sva_stmt, 0) == -1)
-      return CADD_SYNC_FAIL;
-    sqlite3_clear_bindings(sva_stmt);
-    sqlite3_reset(sva_stmt);
-  }
-  for (const CustId& cid : cdel) {
-    sqlite3_bind_int(sva_stmt, 1, cid);
-    sqlite3_bind_int(sva_stmt, 2, (int)StopType::CustOrig);
-    if (sqlite3_step(sva_stmt) != SQLITE_ROW) {
-      print(MessageType::Error) << "sva_stmt failed" << std::endl;
-      throw;
-    }
-    if (sqlite3_step(sva_stmt) != SQLITE_DONE) {
-      print(MessageType::Error) << "sva_stmt multiple rows" << std::endl;
-      throw;
-    }
-    if (sqlite3_column_int(sva_stmt, 0) == -1)
-      return CDEL_SYNC_FAIL;
-    sqlite3_clear_bindings(sva_stmt);
-    sqlite3_reset(sva_stmt);
-    sqlite3_bind_int(sva_stmt, 1, cid);
-    sqlite3_bind_int(sva_stmt, 2, (int)StopType::CustDest);
-    if (sqlite3_step(sva_stmt) != SQLITE_ROW) {
-      print(MessageType::Error) << "sva_stmt failed" << std::endl;
-      throw;
-    }
-    if (sqlite3_step(sva_stmt) != SQLITE_DONE) {
-      print(MessageType::Error) << "sva_stmt multiple rows" << std::endl;
-      throw;
-    }
-    if (sqlite3_column_int(sva_stmt, 0) == -1)
-      return CDEL_SYNC_FAIL;
-    sqlite3_clear_bindings(sva_stmt);
-    sqlite3_reset(sva_stmt);
-  }
+  /* VALIDATE CUSTOMERS (see check_visited) */
+  if (visited != SUCCESS)
+    return visited;
 
   /* COMPARE PREFIXES
    * If mismatch, sync fails. If match, proceed with checking stops */
@@ -518,36 +745,51 @@ RSAlgorithm::sync(const vec_t<Wayp>   & new_rte,
     print << "sync(9) got curloc=" << curloc << std::endl;
     print << "sync(9) got nxtloc=" << nxtloc << std::endl;
   });
-  auto x = std::find_if(new_rte.begin(), new_rte.end(), [&](const Wayp& a) {
-      return a.second == curloc; });
-  if (x == new_rte.end() || (x+1)->second != nxtloc) {
-      DEBUG(3, {
-        if (x == new_rte.end())      print << "sync(9) curloc not in new_rte" << std::endl;
-        if ((x+1)->second != nxtloc) print << "sync(9) nxtloc not in new_rte" << std::endl;
-      });
-      return CURLOC_MISMATCH;
-  }
-
-  /* SYNCHRONIZE ROUTE */
-  /* new_rte prefix must match what the vehicle's traveled */
-  auto i = x + 2;
-  auto j = cur_rte.begin() + idx_lvn + 2;
-  DEBUG(3, { print << "Checking prefix: "; });
-  while (i != new_rte.begin()) {
-    i--; j--;
-    DEBUG(3, { print << " " << i->second << "==" << j->second; });
-    /* Return false if j has reached head of the route */
-    if (i != new_rte.begin() && j == cur_rte.begin()) {
-      DEBUG(3, { print << "sync(9) new_rte prefix exceeds cur_rte" << std::endl; });
-      return PREFIX_MISMATCH;
+  auto x = new_rte.end();
+  if (fresh) {
+    /* Fast path: the new route was built on this version of the vehicle, so
+     * it either still has the traveled prefix or starts at the current node,
+     * and the prefix does not need to be compared */
+    for (const RteIdx& h : {idx_lvn, (RteIdx)0}) {
+      if (h + 1 < new_rte.size() && new_rte.at(h).second == curloc
+                                 && new_rte.at(h+1).second == nxtloc) {
+        x = new_rte.begin() + h;
+        break;
+      }
     }
-    /* Return false if i, j mismatch */
-    if (i->second != j->second) {
-      DEBUG(3, { print << "sync(9) prefix mismatch" << std::endl; });
-      return PREFIX_MISMATCH;
+  }
+  if (x == new_rte.end()) {
+    x = std::find_if(new_rte.begin(), new_rte.end(), [&](const Wayp& a) {
+        return a.second == curloc; });
+    if (x == new_rte.end() || (x+1)->second != nxtloc) {
+        DEBUG(3, {
+          if (x == new_rte.end())      print << "sync(9) curloc not in new_rte" << std::endl;
+          if ((x+1)->second != nxtloc) print << "sync(9) nxtloc not in new_rte" << std::endl;
+        });
+        return CURLOC_MISMATCH;
     }
+
+    /* SYNCHRONIZE ROUTE */
+    /* new_rte prefix must match what the vehicle's traveled */
+    auto i = x + 2;
+    auto j = cur_rte.begin() + idx_lvn + 2;
+    DEBUG(3, { print << "Checking prefix: "; });
+    while (i != new_rte.begin()) {
+      i--; j--;
+      DEBUG(3, { print << " " << i->second << "==" << j->second; });
+      /* Return false if j has reached head of the route */
+      if (i != new_rte.begin() && j == cur_rte.begin()) {
+        DEBUG(3, { print << "sync(9) new_rte prefix exceeds cur_rte" << std::endl; });
+        return PREFIX_MISMATCH;
+      }
+      /* Return false if i, j mismatch */
+      if (i->second != j->second) {
+        DEBUG(3, { print << "sync(9) prefix mismatch" << std::endl; });
+        return PREFIX_MISMATCH;
+      }
+    }
+    DEBUG(3, { print << " new_rte done." << std::endl; });
   }
-  DEBUG(3, { print << " new_rte done." << std::endl; });
 
   /* Synchronize existing stops */
   auto k = new_sch.begin() + 1;
@@ -597,62 +839,50 @@ RSAlgorithm::sync(const vec_t<Wayp>   & new_rte,
 }
 
 void RSAlgorithm::select_matchable_vehicles() {
+  if (!snapshot_) this->refresh_snapshot();
   vehicles_.clear();
-  sqlite3_bind_int(smv_stmt, 1, Cargo::now());
-  sqlite3_bind_int(smv_stmt, 2, (int)VehlStatus::Arrived);
-  while ((rc = sqlite3_step(smv_stmt)) == SQLITE_ROW) {
-    const Wayp* rtebuf = static_cast<const Wayp*>(sqlite3_column_blob(smv_stmt,  8));
-    const Stop* schbuf = static_cast<const Stop*>(sqlite3_column_blob(smv_stmt, 11));
-    vec_t<Wayp> raw_rte(rtebuf, rtebuf + sqlite3_column_bytes(smv_stmt,  8) / sizeof(Wayp));
-    vec_t<Stop> raw_sch(schbuf, schbuf + sqlite3_column_bytes(smv_stmt, 11) / sizeof(Stop));
-    Route route(sqlite3_column_int(smv_stmt, 0), raw_rte);
-    Schedule schedule(sqlite3_column_int(smv_stmt, 0), raw_sch);
-
-    SimlTime vlt = sqlite3_column_int(smv_stmt, 4);
+  for (const Vehicle& vehl : snapshot_->vehicles) {
+    if (vehl.early() > snapshot_->t || vehl.status() == VehlStatus::Arrived)
+      continue;
+    /* Full vehicles stay matchable: a customer can ride after one of their
+     * dropoffs, and chkcap() on the new schedule decides */
 
     /* Vehicles approaching their destination cannot be matchable UNLESS it is
      * a taxi. */
-    if (vlt != -1 &&
-       (schedule.data().at(0).loc() == schedule.data().at(1).loc() &&
-        schedule.data().at(1).type() == StopType::VehlDest))
+    const vec_t<Stop>& sch = vehl.schedule().data();
+    if (vehl.late() != -1 &&
+       (sch.at(0).loc() == sch.at(1).loc() &&
+        sch.at(1).type() == StopType::VehlDest))
       continue;
 
-    /* Construct vehicle object
-     * If permanent taxi, set vehl.dest() to the last wp in the route */
-    NodeId vehl_dest = sqlite3_column_int(smv_stmt, 2);
-    if (vlt == -1) vehl_dest = raw_rte.back().second;
-    Vehicle vehicle(
-        sqlite3_column_int(smv_stmt, 0), // vehl id
-        sqlite3_column_int(smv_stmt, 1), // orig id
-        vehl_dest,                       // dest id
-        sqlite3_column_int(smv_stmt, 3), // early
-        vlt,                             // late
-        sqlite3_column_int(smv_stmt, 5), // load
-        sqlite3_column_int(smv_stmt, 6), // queued
-        sqlite3_column_int(smv_stmt, 10),// nnd
-        route,                           // route
-        schedule,                        // schedule
-        sqlite3_column_int(smv_stmt, 9), // lvn
-        static_cast<VehlStatus>(sqlite3_column_int(smv_stmt, 7))); // status
-    vehicles_.push_back(vehicle);
+    /* If permanent taxi, set vehl.dest() to the last wp in the route */
+    if (vehl.late() == -1) {
+      vehicles_.push_back(Vehicle(
+        vehl.id(), vehl.orig(), vehl.route().data().back().second,
+        vehl.early(), vehl.late(), vehl.load(), vehl.queued(),
+        vehl.next_node_distance(), vehl.route(), vehl.schedule(),
+        vehl.idx_last_visited_node(), vehl.status(), vehl.version()));
+    } else {
+      vehicles_.push_back(vehl);
+    }
   }
-  if (rc != SQLITE_DONE) throw std::runtime_error(sqlite3_errmsg(Cargo::db()));
-  sqlite3_clear_bindings(smv_stmt);
-  sqlite3_reset(smv_stmt);
 }
 
 void RSAlgorithm::select_waiting_customers(
     bool skip_assigned, bool skip_delayed) {
+  /* Bring the waiting customers up to date with the simulation's events
+   * (picked-up and timed-out customers are no longer waiting) */
+  CustEvent ev;
+  while (Cargo::events().pop(ev)) {
+    if (ev.type == CustEventType::Arrive)
+      waiting_[ev.id] = ev.cust;
+    else if (ev.type == CustEventType::Pickup
+          || ev.type == CustEventType::Timeout)
+      waiting_.erase(ev.id);
+  }
   customers_.clear();
-  sqlite3_bind_int(swc_stmt, 1, (int)CustStatus::Waiting);
-  sqlite3_bind_int(swc_stmt, 2, Cargo::now());
-  while ((rc = sqlite3_step(swc_stmt)) == SQLITE_ROW) {
-    Customer customer(
-        sqlite3_column_int(swc_stmt, 0), sqlite3_column_int(swc_stmt, 1),
-        sqlite3_column_int(swc_stmt, 2), sqlite3_column_int(swc_stmt, 3),
-        sqlite3_column_int(swc_stmt, 4), sqlite3_column_int(swc_stmt, 5),
-        static_cast<CustStatus>(sqlite3_column_int(swc_stmt, 6)),
-        sqlite3_column_int(swc_stmt, 7));
+  for (const auto& kv : waiting_) {
+    const Customer& customer = kv.second;
     if (customer.assigned() && skip_assigned) {
       ; // do nothing
     } else if (this->delay(customer.id()) && skip_delayed) {
@@ -661,13 +891,65 @@ void RSAlgorithm::select_waiting_customers(
       customers_.push_back(customer);
     }
   }
-  if (rc != SQLITE_DONE) throw std::runtime_error(sqlite3_errmsg(Cargo::db()));
-  sqlite3_clear_bindings(swc_stmt);
-  sqlite3_reset(swc_stmt);
 }
 
 vec_t<Customer> RSAlgorithm::get_all_customers() {
-  vec_t<Customer> custs;
+  this->refresh_snapshot();
+  return snapshot_->customers;
+}
+
+vec_t<Vehicle> RSAlgorithm::get_all_vehicles() {
+  this->refresh_snapshot();
+  return snapshot_->vehicles;
+}
+
+const SnapshotSptr& RSAlgorithm::snapshot() const { return snapshot_; }
+
+void RSAlgorithm::refresh_snapshot() {
+  std::unique_lock<std::mutex> lock(snmx_);
+  if (live_ && !Cargo::static_mode()) {
+    want_ = true;
+    sncv_.wait(lock, [&]() { return !want_ || !live_; });
+    if (!want_) {
+      snapshot_ = published_;
+      return;
+    }
+  }
+  /* Cargo is not stepping, or is held by ofmx (static mode) while the
+   * algorithm runs; read the database here */
+  want_ = false;
+  lock.unlock();
+  std::shared_ptr<Snapshot> snap = std::make_shared<Snapshot>();
+  { std::lock_guard<std::mutex> dblock(Cargo::dbmx());
+    read_snapshot(*snap);
+  }
+  snapshot_ = snap;
+}
+
+void RSAlgorithm::publish_snapshot() {
+  { std::lock_guard<std::mutex> lock(snmx_);
+    if (!want_) return;
+  }
+  std::shared_ptr<Snapshot> snap = std::make_shared<Snapshot>();
+  read_snapshot(*snap);
+  { std::lock_guard<std::mutex> lock(snmx_);
+    published_ = snap;
+    want_ = false;
+  }
+  sncv_.notify_all();
+}
+
+void RSAlgorithm::live_snapshots(bool live) {
+  { std::lock_guard<std::mutex> lock(snmx_);
+    live_ = live;
+  }
+  sncv_.notify_all();
+}
+
+void RSAlgorithm::read_snapshot(Snapshot& snap) {
+  snap.t = Cargo::now();
+  snap.customers.clear();
+  snap.vehicles.clear();
   while ((rc = sqlite3_step(sac_stmt)) == SQLITE_ROW) {
     Customer customer(
         sqlite3_column_int(sac_stmt, 0), sqlite3_column_int(sac_stmt, 1),
@@ -675,22 +957,18 @@ vec_t<Customer> RSAlgorithm::get_all_customers() {
         sqlite3_column_int(sac_stmt, 4), sqlite3_column_int(sac_stmt, 5),
         static_cast<CustStatus>(sqlite3_column_int(sac_stmt, 6)),
         sqlite3_column_int(sac_stmt, 7));
-    custs.push_back(customer);
+    snap.customers.push_back(customer);
   }
   if (rc != SQLITE_DONE) throw std::runtime_error(sqlite3_errmsg(Cargo::db()));
   sqlite3_reset(sac_stmt);
-  return custs;
-}
-
-vec_t<Vehicle> RSAlgorithm::get_all_vehicles() {
-  vec_t<Vehicle> vehls;
   while ((rc = sqlite3_step(sav_stmt)) == SQLITE_ROW) {
-    const Wayp* rtebuf = static_cast<const Wayp*>(sqlite3_column_blob(sav_stmt,  8));
     const Stop* schbuf = static_cast<const Stop*>(sqlite3_column_blob(sav_stmt, 11));
-    vec_t<Wayp> raw_rte(rtebuf, rtebuf + sqlite3_column_bytes(sav_stmt,  8) / sizeof(Wayp));
+    vec_t<Wayp> raw_rte;
+    PackedRoute(Cargo::segments(), sqlite3_column_blob(sav_stmt, 8),
+                sqlite3_column_bytes(sav_stmt, 8)).unpack(raw_rte);
     vec_t<Stop> raw_sch(schbuf, schbuf + sqlite3_column_bytes(sav_stmt, 11) / sizeof(Stop));
-    Route route(sqlite3_column_int(sav_stmt, 0), raw_rte);
-    Schedule schedule(sqlite3_column_int(sav_stmt, 0), raw_sch);
+    Route route(sqlite3_column_int(sav_stmt, 0), std::move(raw_rte));
+    Schedule schedule(sqlite3_column_int(sav_stmt, 0), std::move(raw_sch));
 
     /* Construct vehicle object */
     Vehicle vehicle(
@@ -705,12 +983,12 @@ vec_t<Vehicle> RSAlgorithm::get_all_vehicles() {
         route,                           // route
         schedule,                        // schedule
         sqlite3_column_int(sav_stmt, 9), // lvn
-        static_cast<VehlStatus>(sqlite3_column_int(sav_stmt, 7))); // status
-    vehls.push_back(vehicle);
+        static_cast<VehlStatus>(sqlite3_column_int(sav_stmt, 7)), // status
+        sqlite3_column_int(sav_stmt, 12)); // version
+    snap.vehicles.push_back(vehicle);
   }
   if (rc != SQLITE_DONE) throw std::runtime_error(sqlite3_errmsg(Cargo::db()));
   sqlite3_reset(sav_stmt);
-  return vehls;
 }
 
 /* Overrideables */
@@ -740,12 +1018,15 @@ void RSAlgorithm::end() {
 }
 
 void RSAlgorithm::listen(bool skip_assigned, bool skip_delayed) {
-  if (Cargo::static_mode)
-    Cargo::ofmx.lock();
+  if (Cargo::static_mode())
+    Cargo::ofmx().lock();
 
   // Start timing -------------------------------
   this->t_listen_0 = hiclock::now();
 
+  this->run_callbacks();
+
+  this->refresh_snapshot();
   this->select_matchable_vehicles();
   int num_vehicles = this->vehicles_.size();
   this->n_vehl_per_batch_.push_back(num_vehicles);
@@ -761,7 +1042,7 @@ void RSAlgorithm::listen(bool skip_assigned, bool skip_delayed) {
   int num_customers = this->customers_.size();
   this->n_cust_per_batch_.push_back(num_customers);
   // Set default timeout (per customer)
-  this->timeout_ = (Cargo::static_mode ? InfInt : 30000);
+  this->timeout_ = (Cargo::static_mode() ? InfInt : 30000);
   for (const auto& customer : this->customers_) {
     this->t_handle_customer_0 = hiclock::now();
     this->handle_customer(customer);
@@ -770,7 +1051,7 @@ void RSAlgorithm::listen(bool skip_assigned, bool skip_delayed) {
       duration(t_handle_customer_0, t_handle_customer_1));
   }
   // Set default timeout (per batch)
-  this->timeout_ = (Cargo::static_mode ? InfInt : 30000);
+  this->timeout_ = (Cargo::static_mode() ? InfInt : 30000);
   this->t_match_0 = hiclock::now();
   this->match();
   this->t_match_1 = hiclock::now();
@@ -783,10 +1064,10 @@ void RSAlgorithm::listen(bool skip_assigned, bool skip_delayed) {
   this->dur_listen_.push_back(dur);
 
   Cargo::paused() = false;
-  Cargo::pause_cv.notify_one();
+  Cargo::pause_cv().notify_one();
 
-  if (Cargo::static_mode) {
-    Cargo::ofmx.unlock();
+  if (Cargo::static_mode()) {
+    Cargo::ofmx().unlock();
     // std::this_thread::sleep_for(milli(100)); // timing hack
     std::this_thread::sleep_for(milli(this->batch_time_ * 1000));
   } else {
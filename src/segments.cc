@@ -0,0 +1,182 @@
+// MIT License
+//
+// Copyright (c) 2018 the Cargo authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <algorithm>
+#include <stdexcept>
+
+#include "libcargo/classes.h"
+#include "libcargo/segments.h"
+#include "libcargo/types.h"
+
+namespace cargo {
+
+/* SegmentTable --------------------------------------------------------------*/
+void SegmentTable::pack(const vec_t<Wayp>& rte, const vec_t<Stop>& sch,
+                        vec_t<RteRun>& runs) {
+  runs.clear();
+  const size_t n = rte.size();
+  size_t i = 0, k = 0;
+  while (i < n) {
+    const NodeId& u = rte.at(i).second;
+    /* Skip the stops at u; the next one ends the path starting at u */
+    while (k < sch.size() && sch.at(k).loc() == u)
+      k++;
+    size_t j = i + 1;
+    if (k < sch.size()) {
+      const NodeId& v = sch.at(k).loc();
+      while (j < n && rte.at(j).second != v)
+        j++;
+    }
+    if (k == sch.size() || j >= n) {  // the rest is not a path between stops
+      for (; i < n; ++i)
+        runs.push_back({(int32_t)i, -1-rte.at(i).second, rte.at(i).first});
+      break;
+    }
+    if (j - i < 2)                    // a run costs more than one waypoint
+      runs.push_back({(int32_t)i, -1-u, rte.at(i).first});
+    else                              // rte[i..j-1]; rte[j] starts the next
+      runs.push_back({(int32_t)i, intern(rte.begin()+i, rte.begin()+j+1),
+                      rte.at(i).first});
+    i = j;
+  }
+}
+
+void SegmentTable::unpack(const RteRun* runs, const size_t& nruns,
+                          vec_t<Wayp>& rte) const {
+  rte.clear();
+  if (nruns == 0) return;
+  rte.reserve(runs[nruns-1].idx + 1);
+  for (size_t r = 0; r < nruns; ++r) {
+    const RteRun& run = runs[r];
+    if (run.ref < 0) {
+      rte.push_back(std::make_pair(run.base, -1-run.ref));
+      continue;
+    }
+    const vec_t<Wayp>& seg = segments_.at(run.ref);
+    const size_t len = runs[r+1].idx - run.idx;  // never the last run
+    for (size_t x = 0; x < len; ++x)
+      rte.push_back(std::make_pair(run.base + seg[x].first, seg[x].second));
+  }
+}
+
+const vec_t<Wayp>& SegmentTable::segment(const SegId& id) const {
+  return segments_.at(id);
+}
+
+size_t SegmentTable::size() const { return segments_.size(); }
+
+void SegmentTable::clear() {
+  segments_.clear();
+  index_.clear();
+}
+
+/* Segments added in the order of their ids index as intern() left them (a
+ * later segment between the same nodes replaced the earlier one) */
+void SegmentTable::add(const vec_t<Wayp>& seg) {
+  if (seg.empty()) throw std::invalid_argument("SegmentTable::add() empty");
+  segments_.push_back(seg);
+  index_[seg.front().second][seg.back().second] = segments_.size() - 1;
+}
+
+void SegmentTable::reclaim(vec_t<vec_t<RteRun>>& routes) {
+  vec_t<SegId> remap(segments_.size(), -1);
+  vec_t<vec_t<Wayp>> kept;
+  for (vec_t<RteRun>& runs : routes) {
+    for (RteRun& run : runs) {
+      if (run.ref < 0) continue;
+      SegId& id = remap.at(run.ref);
+      if (id == -1) {
+        id = kept.size();
+        kept.push_back(std::move(segments_.at(run.ref)));
+      }
+      run.ref = id;
+    }
+  }
+  segments_ = std::move(kept);
+  index_.clear();
+  for (SegId id = 0; id < (SegId)segments_.size(); ++id)
+    index_[segments_[id].front().second][segments_[id].back().second] = id;
+}
+
+/* Return the segment equal to [b, e), adding it if needed. Another path
+ * between the same nodes (e.g. a tie) replaces it in the index. */
+SegId SegmentTable::intern(vec_t<Wayp>::const_iterator b,
+                           vec_t<Wayp>::const_iterator e) {
+  const DistInt& d0 = b->first;
+  SegId& id = index_[b->second].emplace((e-1)->second, -1).first->second;
+  if (id != -1) {
+    const vec_t<Wayp>& seg = segments_.at(id);
+    if (seg.size() == (size_t)(e-b) &&
+        std::equal(b, e, seg.begin(), [&](const Wayp& a, const Wayp& s) {
+          return a.second == s.second && a.first - d0 == s.first; }))
+      return id;
+  }
+  vec_t<Wayp> seg;
+  seg.reserve(e-b);
+  for (auto p = b; p != e; ++p)
+    seg.push_back(std::make_pair(p->first - d0, p->second));
+  segments_.push_back(std::move(seg));
+  id = segments_.size() - 1;
+  return id;
+}
+
+
+/* PackedRoute ---------------------------------------------------------------*/
+PackedRoute::PackedRoute(const SegmentTable& table, const void* blob,
+                         const size_t& bytes)
+    : table_(table), runs_(static_cast<const RteRun*>(blob)),
+      nruns_(bytes / sizeof(RteRun)), hint_(0) {}
+
+size_t PackedRoute::size() const {
+  return nruns_ == 0 ? 0 : runs_[nruns_-1].idx + 1;
+}
+
+DistInt PackedRoute::cost() const {
+  if (nruns_ == 0) throw std::out_of_range("PackedRoute::cost() empty route");
+  return runs_[nruns_-1].base;
+}
+
+Wayp PackedRoute::at(const RteIdx& i) const {
+  if (i >= size()) throw std::out_of_range("PackedRoute::at()");
+  /* Waypoints are mostly read in order; try the last run and the next one
+   * before searching */
+  auto in_run = [&](const size_t& r) {
+    return (RteIdx)runs_[r].idx <= i && (r+1 == nruns_ || i < (RteIdx)runs_[r+1].idx); };
+  if (!in_run(hint_)) {
+    if (hint_+1 < nruns_ && in_run(hint_+1))
+      hint_++;
+    else
+      hint_ = std::upper_bound(runs_, runs_ + nruns_, i,
+          [](const RteIdx& a, const RteRun& b) { return a < (RteIdx)b.idx; })
+        - runs_ - 1;
+  }
+  const RteRun& run = runs_[hint_];
+  if (run.ref < 0)
+    return std::make_pair(run.base, -1-run.ref);
+  const Wayp& wp = table_.segment(run.ref).at(i - run.idx);
+  return std::make_pair(run.base + wp.first, wp.second);
+}
+
+void PackedRoute::unpack(vec_t<Wayp>& rte) const {
+  table_.unpack(runs_, nruns_, rte);
+}
+
+}  // namespace cargo
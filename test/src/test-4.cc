@@ -0,0 +1,112 @@
+#include "libcargo.h"
+#include "catch.hpp"
+
+using namespace cargo;
+
+SCENARIO("print test-4 intro") {
+  std::cout
+    << "-----------------------------------------------------------\n"
+    << " C A R G O -- Test Packed Routes \n"
+    << "-----------------------------------------------------------"
+    << std::endl;
+}
+
+/* A straight route through nodes first..last, 10 apart, starting at d0 */
+static vec_t<Wayp> line(const NodeId& first, const NodeId& last,
+                        const DistInt& d0) {
+  vec_t<Wayp> rte;
+  for (NodeId u = first; u <= last; ++u)
+    rte.push_back(std::make_pair(d0 + 10*(u-first), u));
+  return rte;
+}
+
+static void check_same(const vec_t<Wayp>& a, const vec_t<Wayp>& b) {
+  REQUIRE(a.size() == b.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    CHECK(a.at(i).first == b.at(i).first);
+    CHECK(a.at(i).second == b.at(i).second);
+  }
+}
+
+SCENARIO("packed routes unpack to the same waypoints", "[segments.h]") {
+
+  GIVEN("a route 1..10 with stops at 1, 4, 8 and 10") {
+    SegmentTable table;
+    const vec_t<Wayp> rte = line(1, 10, 0);
+    const vec_t<Stop> sch = {
+      Stop(1, 1, StopType::VehlOrig, 0, 100),
+      Stop(2, 4, StopType::CustOrig, 0, 100),
+      Stop(2, 8, StopType::CustDest, 0, 100),
+      Stop(1, 10, StopType::VehlDest, 0, 100)};
+    vec_t<RteRun> runs;
+    table.pack(rte, sch, runs);
+
+    THEN("unpack gives the route back") {
+      vec_t<Wayp> out;
+      table.unpack(runs.data(), runs.size(), out);
+      check_same(rte, out);
+    }
+
+    THEN("PackedRoute reads each waypoint and the cost") {
+      const PackedRoute packed(table, runs.data(), runs.size()*sizeof(RteRun));
+      REQUIRE(packed.size() == rte.size());
+      CHECK(packed.cost() == rte.back().first);
+      for (RteIdx i = 0; i < rte.size(); ++i)
+        CHECK(packed.at(i) == rte.at(i));
+      CHECK(packed.at(2) == rte.at(2));  // out of order
+    }
+
+    THEN("the segments between stops are interned once") {
+      const size_t nsegs = table.size();
+      vec_t<RteRun> again;
+      table.pack(rte, sch, again);
+      CHECK(table.size() == nsegs);
+
+      /* Another route through 4..8 at another distance shares its segment */
+      const vec_t<Wayp> other = line(4, 8, 500);
+      const vec_t<Stop> other_sch = {
+        Stop(3, 4, StopType::VehlOrig, 0, 100),
+        Stop(3, 8, StopType::VehlDest, 0, 100)};
+      vec_t<RteRun> other_runs;
+      table.pack(other, other_sch, other_runs);
+      CHECK(table.size() == nsegs);
+      vec_t<Wayp> out;
+      table.unpack(other_runs.data(), other_runs.size(), out);
+      check_same(other, out);
+    }
+
+    THEN("a waypoint before the first stop is kept (last-visited node)") {
+      vec_t<Wayp> moved = line(2, 10, 10);
+      moved.insert(moved.begin(), std::make_pair(0, 1));
+      const vec_t<Stop> rest(sch.begin()+1, sch.end());
+      vec_t<RteRun> moved_runs;
+      table.pack(moved, rest, moved_runs);
+      vec_t<Wayp> out;
+      table.unpack(moved_runs.data(), moved_runs.size(), out);
+      check_same(moved, out);
+    }
+
+    THEN("reclaim keeps only the segments still used") {
+      const vec_t<Wayp> other = line(20, 30, 0);
+      const vec_t<Stop> other_sch = {
+        Stop(3, 20, StopType::VehlOrig, 0, 100),
+        Stop(3, 30, StopType::VehlDest, 0, 100)};
+      vec_t<RteRun> other_runs;
+      table.pack(other, other_sch, other_runs);
+      REQUIRE(table.size() == 4);
+
+      vec_t<vec_t<RteRun>> routes = {other_runs};
+      table.reclaim(routes);
+      CHECK(table.size() == 1);
+      vec_t<Wayp> out;
+      table.unpack(routes.at(0).data(), routes.at(0).size(), out);
+      check_same(other, out);
+
+      /* The dropped segments are interned again when used */
+      table.pack(rte, sch, runs);
+      CHECK(table.size() == 4);
+      table.unpack(runs.data(), runs.size(), out);
+      check_same(rte, out);
+    }
+  }
+}
@@ -0,0 +1,73 @@
+#include <cstdio>
+#include <fstream>
+
+#include "libcargo.h"
+#include "catch.hpp"
+
+using namespace cargo;
+
+SCENARIO("print test-5 intro") {
+  std::cout
+    << "-----------------------------------------------------------\n"
+    << " C A R G O -- Test Checkpoints \n"
+    << "-----------------------------------------------------------"
+    << std::endl;
+}
+
+/* The lines of a .sol file up to its timings (these vary between runs) */
+static vec_t<std::string> read_sol(const std::string& path) {
+  vec_t<std::string> lines;
+  std::ifstream f(path);
+  for (std::string line; std::getline(f, line); ) {
+    if (line.find("(ms)") != std::string::npos) break;
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+SCENARIO("a restored run ends like the run it was saved from", "[cargo.h]") {
+
+  GIVEN("tiny and an algorithm that matches nothing (so runs are repeatable)") {
+    Options option;
+    option.path_to_roadnet = "data/tiny.rnet";
+    option.path_to_problem = "data/tiny-m5n30-s10-x1.instance";
+    option.time_multiplier = 1000;
+
+    /* Full run, checkpointing every 50 ticks; the last checkpoint is kept */
+    SimlTime end;
+    { option.checkpoint_interval = 50;
+      Cargo cargo(option);
+      RSAlgorithm alg("ckpt_full", false);
+      cargo.start(alg);
+      end = Cargo::now();
+    }
+    REQUIRE(end > 50);
+    const vec_t<std::string> full = read_sol("ckpt_full.sol");
+    REQUIRE(full.size() > 2);
+
+    THEN("restoring the last checkpoint finishes with the same solution") {
+      option.checkpoint_interval = 0;
+      Cargo cargo(option);
+      RSAlgorithm alg("ckpt_resumed", false);
+      cargo.restore("ckpt_full.ckpt", alg);
+      CHECK(Cargo::now() > 50);
+      CHECK(Cargo::now() <= end);
+      cargo.start(alg);
+      CHECK(Cargo::now() == end);
+      CHECK(read_sol("ckpt_resumed.sol") == full);
+    }
+
+    THEN("a state file paired with another checkpoint's database is rejected") {
+      option.checkpoint_interval = 0;
+      { Cargo cargo(option);
+        RSAlgorithm alg("ckpt_stop", false);
+        cargo.start(alg, 60, 0);  // stops at t=60
+        cargo.checkpoint("ckpt_stop.ckpt", alg);
+      }
+      std::rename("ckpt_stop.ckpt.db", "ckpt_full.ckpt.db");
+      Cargo cargo(option);
+      RSAlgorithm alg("ckpt_mixed", false);
+      REQUIRE_THROWS(cargo.restore("ckpt_full.ckpt", alg));
+    }
+  }
+}
@@ -0,0 +1,92 @@
+#include "libcargo.h"
+#include "catch.hpp"
+
+using namespace cargo;
+
+SCENARIO("print test-6 intro") {
+  std::cout
+    << "-----------------------------------------------------------\n"
+    << " C A R G O -- Test Matchable Vehicles \n"
+    << "-----------------------------------------------------------"
+    << std::endl;
+}
+
+/* Inserts each customer into the first vehicle where the schedule passes
+ * chkcap() and chktw(), and records whether a full vehicle was offered and
+ * whether one was matched */
+class FirstFit : public RSAlgorithm {
+ public:
+  FirstFit() : RSAlgorithm("full_vehl", false),
+               saw_full(false), matched_full(false) {
+    this->batch_time() = 1;
+  }
+  bool saw_full, matched_full;
+
+  void handle_vehicle(const Vehicle& vehl) {
+    if (vehl.capacity() == 0) saw_full = true;
+    fleet_.push_back(vehl);
+  }
+
+  void handle_customer(const Customer& cust) {
+    for (const Vehicle& vehl : fleet_) {
+      MutableVehicle cand(vehl);
+      vec_t<Stop> sch;
+      vec_t<Wayp> rte;
+      sop_insert(cand, cust, sch, rte, Cargo::gtree());
+      if (!chkcap(cand.capacity(), sch) || !chktw(sch, rte)) continue;
+      if (this->assign({cust.id()}, {}, rte, sch, cand)) {
+        if (vehl.capacity() == 0) matched_full = true;
+        return;
+      }
+    }
+  }
+
+  void listen(bool skip_assigned, bool skip_delayed) {
+    fleet_.clear();
+    RSAlgorithm::listen(skip_assigned, skip_delayed);
+  }
+
+ private:
+  vec_t<Vehicle> fleet_;
+};
+
+SCENARIO("full vehicles are matchable and chkcap() decides", "[rsalgorithm.h]") {
+
+  GIVEN("a schedule for a vehicle with no room left") {
+    /* Vehicle 1 carries customer 2 to node 7; customer 3 waits at node 15 */
+    const vec_t<Stop> after = {
+      Stop(1, 0, StopType::VehlOrig, 0, 1200),
+      Stop(2, 7, StopType::CustDest, 0, 600),
+      Stop(3, 15, StopType::CustOrig, 30, 630),
+      Stop(3, 23, StopType::CustDest, 30, 630),
+      Stop(1, 63, StopType::VehlDest, 0, 1200)};
+    const vec_t<Stop> before = {
+      Stop(1, 0, StopType::VehlOrig, 0, 1200),
+      Stop(3, 15, StopType::CustOrig, 30, 630),
+      Stop(2, 7, StopType::CustDest, 0, 600),
+      Stop(3, 23, StopType::CustDest, 30, 630),
+      Stop(1, 63, StopType::VehlDest, 0, 1200)};
+
+    THEN("a pickup after a dropoff fits, a pickup before it does not") {
+      CHECK(chkcap(0, after));
+      CHECK_FALSE(chkcap(0, before));
+    }
+  }
+
+  GIVEN("tiny, one vehicle of capacity 1, and a customer appearing while it is full") {
+    Options option;
+    option.path_to_roadnet = "data/tiny.rnet";
+    option.path_to_problem = "data/tiny-m1n2-s10-x1.instance";
+    option.time_multiplier = 1000;
+    option.static_mode = true;  // the algorithm sees every batch
+    Cargo cargo(option);
+    FirstFit alg;
+    cargo.start(alg);
+
+    THEN("the full vehicle is offered and takes the customer") {
+      CHECK(alg.saw_full);
+      CHECK(alg.matched_full);
+      CHECK(alg.matches() == 2);
+    }
+  }
+}
@@ -0,0 +1,82 @@
+#include <fstream>
+#include <thread>
+
+#include "libcargo.h"
+#include "catch.hpp"
+
+using namespace cargo;
+
+SCENARIO("print test-7 intro") {
+  std::cout
+    << "-----------------------------------------------------------\n"
+    << " C A R G O -- Test Simulations in One Process \n"
+    << "-----------------------------------------------------------"
+    << std::endl;
+}
+
+/* The lines of an output file, up to the timings of a .sol (these vary
+ * between runs) */
+static vec_t<std::string> read_out(const std::string& path) {
+  vec_t<std::string> lines;
+  std::ifstream f(path);
+  for (std::string line; std::getline(f, line); ) {
+    if (line.find("(ms)") != std::string::npos) break;
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+SCENARIO("two simulations in one process keep their outputs apart", "[cargo.h]") {
+
+  GIVEN("tiny, two instances, and algorithms that match nothing") {
+    Options opt_a, opt_b;
+    opt_a.path_to_roadnet = opt_b.path_to_roadnet = "data/tiny.rnet";
+    opt_a.path_to_problem = "data/tiny-m5n30-s10-x1.instance";
+    opt_b.path_to_problem = "data/tiny-m1n2-s10-x1.instance";
+    opt_a.time_multiplier = opt_b.time_multiplier = 1000;
+
+    /* Each simulation on its own, for reference */
+    vec_t<std::string> sol_a, dat_a, sol_b, dat_b;
+    { Cargo a(opt_a);
+      RSAlgorithm alg_a("two_a", false);
+      a.start(alg_a);
+    }
+    sol_a = read_out("two_a.sol");
+    dat_a = read_out("two_a.dat");
+    { Cargo b(opt_b);
+      RSAlgorithm alg_b("two_b", false);
+      b.start(alg_b);
+    }
+    sol_b = read_out("two_b.sol");
+    dat_b = read_out("two_b.dat");
+    REQUIRE(sol_a.size() > 2);
+    REQUIRE(sol_b.size() > 2);
+    REQUIRE(sol_a != sol_b);
+
+    /* Both live; this thread is bound to b, the last one made */
+    Cargo a(opt_a);
+    a.bind();
+    RSAlgorithm alg_a("two_a", false);
+    Cargo b(opt_b);
+    RSAlgorithm alg_b("two_b", false);
+
+    THEN("run one after the other on this thread, each writes its own output") {
+      a.start(alg_a);
+      b.start(alg_b);
+      CHECK(read_out("two_a.sol") == sol_a);
+      CHECK(read_out("two_a.dat") == dat_a);
+      CHECK(read_out("two_b.sol") == sol_b);
+      CHECK(read_out("two_b.dat") == dat_b);
+    }
+
+    THEN("run at the same time on two threads, each writes its own output") {
+      std::thread thread_a([&]() { a.start(alg_a); });
+      b.start(alg_b);
+      thread_a.join();
+      CHECK(read_out("two_a.sol") == sol_a);
+      CHECK(read_out("two_a.dat") == dat_a);
+      CHECK(read_out("two_b.sol") == sol_b);
+      CHECK(read_out("two_b.dat") == dat_b);
+    }
+  }
+}
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <cstring>
 #include <algorithm>
+#include <unistd.h>
 
 #include "GTree.h"
 
@@ -9,6 +10,8 @@ namespace GTree {
 long long           Additional_Memory;
 long long           ts, te;
 static int          rootp = 0;
+static const char  *Node_Chunk_File = "GP_Tree.nodes";
+static const char  *Spill_File      = "GP_Tree.spill";
 std::vector<coor>   coordinate;
 Wide_KNN_           Wide_KNN;
 G_Tree              tree;
@@ -290,6 +293,17 @@ void Graph::clear() {
     id.clear();
 }
 
+void Graph::release() {
+    clear();
+    std::vector<int>().swap(id);
+    std::vector<int>().swap(head);
+    std::vector<int>().swap(list);
+    std::vector<int>().swap(next);
+    std::vector<int>().swap(cost);
+    std::vector<int>().swap(color);
+    std::vector<int>().swap(con);
+}
+
 void Graph::draw() {
     // printf("Graph:%d n=%d m=%d\n", this, n, m);
     for (int i = 0; i < n; i++)
@@ -776,6 +790,8 @@ void Matrix::clear() {
     for (int i = 0; i < n; i++)
         delete[] a[i];
     delete[] a;
+    a = NULL;
+    n = 0;
 }
 
 void Matrix::floyd() {
@@ -959,9 +975,28 @@ void G_Tree::save() {
     save_vector(id_in_node);
     save_vector_vector(car_in_node);
     save_vector(car_offset);
+    FILE *chunks = NULL;
+    if (out_of_core)
+        chunks = fopen(Node_Chunk_File, "r");
+    std::vector<char> buf(1 << 16);
     for (int i = 0; i < node_size; i++) {
         printf("\n");
-        node[i].save();
+        if (chunks && chunk_at[i] != -1) {
+            // Already written by build_dist2_out_of_core
+            fseek(chunks, chunk_at[i], SEEK_SET);
+            for (long k = chunk_end[i] - chunk_at[i]; k > 0;) {
+                size_t len = fread(&buf[0], 1, std::min(k, (long)buf.size()), chunks);
+                if (len == 0)
+                    break;
+                fwrite(&buf[0], 1, len, stdout);
+                k -= len;
+            }
+        } else
+            node[i].save();
+    }
+    if (chunks) {
+        fclose(chunks);
+        remove(Node_Chunk_File);
     }
 }
 
@@ -1080,28 +1115,39 @@ void G_Tree::build(const Graph &g, int x, int f) {
             }
             tot[node[x].color[i]]++;
         }
+        if (out_of_core) {
+            make_border_edge_list(x);
+            node[x].G.release();
+        }
         for (int i = 0; i < node[x].part; i++)
             build(g, node[x].son[i]);
     } else if (node[x].n > 50)
         std::cout << std::endl;
-    node[x].dist.init(node[x].borders.size());
-    node[x].order.init(node[x].borders.size());
-    node[x].order.cover(-INF);
+    if (!out_of_core) { // else allocated by build_dist1_out_of_core
+        node[x].dist.init(node[x].borders.size());
+        node[x].order.init(node[x].borders.size());
+        node[x].order.cover(-INF);
+    }
     if (x == 1) {
         for (int i = 1; i < std::min(1000, node_tot - 1); i++)
             if (node[i].n > 50) {
-                printf("x=%d deep=%d n=%d ", i, node[i].deep, node[i].G.n);
-                printf("border=%d real_border=%d\n", (int)node[i].borders.size(),
-                       real_border_number(i));
+                printf("x=%d deep=%d n=%d ", i, node[i].deep, node[i].n);
+                if (out_of_core) // subgraph is gone
+                    printf("border=%d\n", (int)node[i].borders.size());
+                else
+                    printf("border=%d real_border=%d\n",
+                           (int)node[i].borders.size(), real_border_number(i));
             }
         printf("begin_build_border_in_father_son\n");
         build_border_in_father_son();
-        printf("begin_build_dist\n");
-        build_dist1(root);
-        printf("begin_build_dist2\n");
-        build_dist2(root);
+        if (!out_of_core) { // else see build_out_of_core
+            printf("begin_build_dist\n");
+            build_dist1(root);
+            printf("begin_build_dist2\n");
+            build_dist2(root);
+        }
         id_in_node.clear();
-        for (int i = 0; i < node[root].G.n; i++)
+        for (int i = 0; i < node[root].n; i++)
             id_in_node.push_back(-1);
         for (int i = 1; i < node_tot; i++)
             if (node[i].G.n == 1)
@@ -1188,6 +1234,196 @@ void G_Tree::build_dist2(int x) {
     }
 }
 
+void G_Tree::build_out_of_core(const Graph &g, long long bytes) {
+    out_of_core = true;
+    budget = bytes;
+    resident = 0;
+    in_core = std::vector<char>(G.n * 2 + 2, 0);
+    spill_at = std::vector<long>(G.n * 2 + 2, -1);
+    chunk_at = std::vector<long>(G.n * 2 + 2, -1);
+    chunk_end = std::vector<long>(G.n * 2 + 2, -1);
+    spill_file = fopen(Spill_File, "w+b");
+    if (!spill_file) {
+        std::printf("Cannot create %s!\n", Spill_File);
+        exit(EXIT_FAILURE);
+    }
+    build(g);
+    printf("begin_build_dist (out-of-core, budget %lld MB)\n", budget >> 20);
+    build_dist1_out_of_core(root);
+    printf("begin_build_dist2 (out-of-core)\n");
+    fflush(stdout);
+    // Nodes are written to the chunk file in the order they become final;
+    // save() stitches them back together in node order
+    int out = dup(fileno(stdout));
+    freopen(Node_Chunk_File, "w", stdout);
+    build_dist2_out_of_core(root);
+    fflush(stdout);
+    dup2(out, fileno(stdout));
+    close(out);
+    fclose(spill_file);
+    spill_file = NULL;
+    remove(Spill_File);
+}
+
+void G_Tree::make_border_edge_list(int x) {
+    int i, j;
+    node[x].border_edge.clear();
+    std::map<int, std::pair<int, int>>::iterator iter;
+    for (iter = node[x].borders.begin(); iter != node[x].borders.end(); iter++) {
+        i = iter->second.second;
+        for (j = node[x].G.head[i]; j; j = node[x].G.next[j])
+            if (node[x].color[i] != node[x].color[node[x].G.list[j]]) {
+                node[x].border_edge.push_back(iter->second.first);
+                node[x].border_edge.push_back(
+                    node[x].borders[node[x].G.id[node[x].G.list[j]]].first);
+                node[x].border_edge.push_back(node[x].G.cost[j]);
+            }
+    }
+}
+
+void G_Tree::alloc_matrix(int x) {
+    int n = node[x].borders.size();
+    node[x].dist.init(n);
+    node[x].order.init(n);
+    node[x].order.cover(-INF);
+    in_core[x] = 1;
+    resident += 2LL * n * n * sizeof(int);
+}
+
+// A matrix is spilled at most once: after build_dist1_out_of_core it does not
+// change until build_dist2_out_of_core reloads it for the last time.
+void G_Tree::spill_matrix(int x) {
+    if (!in_core[x])
+        return;
+    if (spill_at[x] == -1) {
+        fseek(spill_file, 0, SEEK_END);
+        spill_at[x] = ftell(spill_file);
+        int n = node[x].dist.n;
+        fwrite(&n, sizeof(int), 1, spill_file);
+        for (int i = 0; i < n; i++)
+            fwrite(node[x].dist.a[i], sizeof(int), n, spill_file);
+        for (int i = 0; i < n; i++)
+            fwrite(node[x].order.a[i], sizeof(int), n, spill_file);
+    }
+    release_matrix(x);
+}
+
+void G_Tree::unspill_matrix(int x) {
+    if (in_core[x])
+        return;
+    int n = 0;
+    fseek(spill_file, spill_at[x], SEEK_SET);
+    if (fread(&n, sizeof(int), 1, spill_file) != 1) {
+        std::printf("Spill file is corrupt!\n");
+        exit(EXIT_FAILURE);
+    }
+    node[x].dist.init(n);
+    node[x].order.init(n);
+    for (int i = 0; i < n; i++)
+        fread(node[x].dist.a[i], sizeof(int), n, spill_file);
+    for (int i = 0; i < n; i++)
+        fread(node[x].order.a[i], sizeof(int), n, spill_file);
+    in_core[x] = 1;
+    resident += 2LL * n * n * sizeof(int);
+}
+
+void G_Tree::release_matrix(int x) {
+    if (!in_core[x])
+        return;
+    int n = node[x].dist.n;
+    node[x].dist.clear();
+    node[x].order.clear();
+    in_core[x] = 0;
+    resident -= 2LL * n * n * sizeof(int);
+}
+
+// Same result as build_dist1, but the father pulls from its sons (one at a
+// time) instead of each son pushing into an already-allocated father
+void G_Tree::build_dist1_out_of_core(int x) {
+    for (int i = 0; i < node[x].part; i++)
+        if (node[x].son[i])
+            build_dist1_out_of_core(node[x].son[i]);
+    alloc_matrix(x);
+    for (int k = 0; k < node[x].part; k++) {
+        int y = node[x].son[k], i, j;
+        if (!y)
+            continue;
+        unspill_matrix(y);
+        std::map<int, std::pair<int, int>>::iterator y_iter1, x_iter1;
+        std::vector<int> id_in_fa(node[y].borders.size());
+        for (y_iter1 = node[y].borders.begin();
+             y_iter1 != node[y].borders.end(); y_iter1++) {
+            x_iter1 = node[x].borders.find(y_iter1->first);
+            if (x_iter1 == node[x].borders.end())
+                id_in_fa[y_iter1->second.first] = -1;
+            else
+                id_in_fa[y_iter1->second.first] = x_iter1->second.first;
+        }
+        for (i = 0; i < (int)node[y].borders.size(); i++)
+            for (j = 0; j < (int)node[y].borders.size(); j++)
+                if (id_in_fa[i] != -1 && id_in_fa[j] != -1) {
+                    int *p = &node[x].dist.a[id_in_fa[i]][id_in_fa[j]];
+                    if ((*p) > node[y].dist.a[i][j]) {
+                        (*p) = node[y].dist.a[i][j];
+                        node[x].order.a[id_in_fa[i]][id_in_fa[j]] = -3;
+                    }
+                }
+        if (resident > budget)
+            spill_matrix(y);
+    }
+    if (node[x].son[0]) {
+        const std::vector<int> &e = node[x].border_edge;
+        for (int i = 0; i + 2 < (int)e.size(); i += 3)
+            if (node[x].dist.a[e[i]][e[i + 1]] > e[i + 2]) {
+                node[x].dist.a[e[i]][e[i + 1]] = e[i + 2];
+                node[x].order.a[e[i]][e[i + 1]] = -1;
+            }
+        std::vector<int>().swap(node[x].border_edge);
+        node[x].dist.floyd(node[x].order);
+    }
+    if (x != root && resident > budget)
+        spill_matrix(x);
+}
+
+// Same result as build_dist2, but each son is finished (and written) before
+// the next one is loaded
+void G_Tree::build_dist2_out_of_core(int x) {
+    unspill_matrix(x);
+    if (x != root)
+        node[x].dist.floyd(node[x].order);
+    chunk_at[x] = ftell(stdout);
+    node[x].save();
+    chunk_end[x] = ftell(stdout);
+    if (node[x].son[0]) {
+        std::vector<std::vector<int>> member(node[x].part);
+        std::vector<int> id_(node[x].borders.size());
+        std::map<int, std::pair<int, int>>::iterator iter1;
+        for (iter1 = node[x].borders.begin();
+             iter1 != node[x].borders.end(); iter1++) {
+            int c = node[x].color[iter1->second.second];
+            int y = node[x].son[c];
+            member[c].push_back(iter1->second.first);
+            id_[iter1->second.first] = node[y].borders[iter1->first].first;
+        }
+        for (int c = 0; c < node[x].part; c++) {
+            int y = node[x].son[c];
+            if (!y)
+                continue;
+            unspill_matrix(y);
+            for (int i : member[c])
+                for (int j : member[c]) {
+                    int *p = &node[y].dist.a[id_[i]][id_[j]];
+                    if ((*p) > node[x].dist.a[i][j]) {
+                        (*p) = node[x].dist.a[i][j];
+                        node[y].order.a[id_[i]][id_[j]] = -2;
+                    }
+                }
+            build_dist2_out_of_core(y);
+        }
+    }
+    release_matrix(x);
+}
+
 void G_Tree::build_border_in_father_son() {
     int i, x, y;
     for (x = 1; x < node_tot; x++) {
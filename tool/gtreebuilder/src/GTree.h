@@ -4,6 +4,8 @@
 #include <map>
 #include <metis.h>
 #include <cmath>
+#include <cstdio>
+#include <string>
 #include <vector>
 
 namespace GTree {
@@ -78,6 +80,7 @@ struct Graph {
     void add(int, int, int);
     void init(int, int, int = 1);
     void clear();
+    void release(); // clear() and give the memory back
     void draw();
 
     std::vector<int> color;
@@ -152,6 +155,10 @@ struct Node {
     std::vector<std::pair<int, int>> min_car_dist;
     std::map<int, std::pair<int, int>> borders;
 
+    // (id1, id2, cost) triples found by make_border_edge_list; used in place
+    // of G by the out-of-core build, which releases G after partitioning
+    std::vector<int> border_edge;
+
     Matrix dist, order;
 
     void save();
@@ -206,6 +213,30 @@ struct G_Tree { // Here we go!
     int begin[10000];
     int end[10000];
 
+    // Out-of-core build. The whole tree is partitioned first, keeping only
+    // the leaves' subgraphs. The border matrices are then built one subtree
+    // at a time; a finished subtree is spilled to disk whenever the resident
+    // matrices exceed the budget (bytes), and each node is written out as
+    // soon as its matrices are final, so only the path from the root to the
+    // current node has to stay in memory.
+    bool out_of_core = false;
+    long long budget = 0;
+    long long resident = 0;
+    FILE *spill_file = NULL;
+    std::vector<char> in_core;
+    std::vector<long> spill_at;
+    std::vector<long> chunk_at;
+    std::vector<long> chunk_end;
+
+    void build_out_of_core(const Graph &, long long);
+    void build_dist1_out_of_core(int = 1);
+    void build_dist2_out_of_core(int = 1);
+    void make_border_edge_list(int);
+    void alloc_matrix(int);
+    void spill_matrix(int);
+    void unspill_matrix(int);
+    void release_matrix(int);
+
     bool push_borders_up_add_min_car_dist(int, int);
     bool push_borders_up_del_min_car_dist(int, int);
     int push_borders_up_catch_KNN_min_dist_car(int);
@@ -7,7 +7,10 @@
 #include <string>
 
 void PrintUsage() {
-  std::cerr << "Usage: ./gtreebuilder <edge_file>\n"
+  std::cerr << "Usage: ./gtreebuilder <edge_file> [budget_mb]\n"
+            << "\n"
+            << "With [budget_mb], build out-of-core: border matrices are\n"
+            << "spilled to disk once they exceed budget_mb megabytes.\n"
             << "\n"
             << "<edge_file> format:\n"
             << "first line: [# of nodes] [# of edges]\n"
@@ -28,7 +31,10 @@ int main(int argc, char **argv) {
   std::printf("nodes: %d\tedges: %d\n", graph.n, graph.m);
   GTree::setAdMem(2 * graph.n * log2(graph.n));
   GTree::G_Tree gtree = GTree::get();
-  gtree.build(graph);
+  if (argc > 2)
+    gtree.build_out_of_core(graph, std::stoll(argv[2]) << 20);
+  else
+    gtree.build(graph);
   GTree::save(gtree); // Saves to "GP_Tree.gtree"
   std::printf("Complete! Saved to \"GP_Tree.gtree\"\n");
 
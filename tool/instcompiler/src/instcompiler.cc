@@ -0,0 +1,43 @@
+// MIT License
+//
+// Copyright (c) 2018 the Cargo authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <iostream>
+#include <string>
+
+#include "libcargo.h"
+
+using namespace cargo;
+
+int main(int argc, char** argv) {
+  if (argc < 3 || argc > 4) {
+    std::cout << "Usage: ./instcompiler <rnet> <instance> [output]" << std::endl;
+    return 1;
+  }
+  Options op;
+  op.path_to_roadnet = argv[1];
+  op.path_to_problem = argv[2];
+  const Filepath output = (argc == 4 ? argv[3] : op.path_to_problem + ".bin");
+
+  Cargo cargo(op);  // loads the network and computes base costs and routes
+  cargo.compile(output);
+  std::cout << "Wrote " << output << std::endl;
+  return 0;
+}
@@ -0,0 +1,452 @@
+// MIT License
+//
+// Copyright (c) 2018 the Cargo authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+
+#include "libcargo.h"
+
+using namespace cargo;
+
+/* Replay a simulation's event log (*.dat) without the algorithm: rebuild the
+ * fleet tick by tick from the logged routes (R), moves (V), matches (M),
+ * pickups/dropoffs (P/D), timeouts (T), arrivals (A) and queue sizes (Q),
+ * and recompute the solution metrics from them. With -v, also check that the
+ * logged solution is feasible. */
+
+struct VehlState {
+  vec_t<NodeId> rte;                        // last route (R), from its lvn
+  vec_t<DistInt> dist;                      // distance along rte
+  size_t pos = 0;                           // rte index of last-visited node
+  DistInt base = 0;                         // traveled before rte[0]
+  Load onboard = 0;
+  bool seen = false;                        // has had a route
+  bool arrived = false;
+  vec_t<NodeId> moved;                      // nodes visited this tick
+  DistInt cost() const { return base + (dist.empty() ? 0 : dist.back()); }
+};
+
+struct CustState {
+  VehlId assigned = 0;
+  SimlTime pickup = -1;
+  SimlTime dropoff = -1;
+  bool timedout = false;
+};
+
+class Replay {
+ public:
+  Replay(const Filepath &, const Filepath &, bool);
+  void run(const Filepath &, const Filepath &, const SimlTime &);
+  void put_solution(std::ostream &);
+  size_t violations() const { return nviol_; }
+
+ private:
+  std::shared_ptr<RoadNetwork> road_;
+  ProblemSet probset_;
+  Speed speed_;
+  bool verify_;
+
+  /* By trip id - base_ */
+  TripId base_;
+  vec_t<Trip> trips_;
+  vec_t<DistInt> costs_;                    // customer base costs
+  vec_t<VehlState> vehls_;
+  vec_t<CustState> custs_;
+  size_t total_vehicles_, total_customers_;
+
+  SimlTime t_;
+  vec_t<std::pair<CustId, bool>> stops_;    // this tick's pickups (true), dropoffs
+  long int base_cost_, traveled_, penalty_;
+  long int sum_pickup_delay_, sum_trip_delay_;
+  size_t npickups_, ndropoffs_, ntimeouts_, nviol_;
+  int matches_, waiting_;
+
+  size_t idx(const TripId &) const;         // throws if not in the instance
+  void violation(const std::string &);
+  void route(const VehlId &, const vec_t<NodeId> &);
+  void move(const VehlId &, const NodeId &);
+  void end_tick();                          // check this tick's stops
+  void put_metrics(std::ostream &, const SimlTime &);  // snapshot as of t
+};
+
+Replay::Replay(const Filepath& path_to_roadnet, const Filepath& path_to_problem,
+               bool verify)
+    : verify_(verify), total_vehicles_(0), total_customers_(0), t_(-1),
+      base_cost_(0), traveled_(0), penalty_(0), sum_pickup_delay_(0),
+      sum_trip_delay_(0), npickups_(0), ndropoffs_(0), ntimeouts_(0),
+      nviol_(0), matches_(0), waiting_(0) {
+  road_ = Cargo::load_road(path_to_roadnet);
+  speed_ = parse_speed(path_to_problem);
+  if (speed_ == -1) throw std::runtime_error("Missing -s in instance name.");
+
+  /* Trips, and the base costs of the customers (vehicles get theirs from
+   * their first route) */
+  vec_t<Trip> trips;
+  vec_t<DistInt> costs;                     // by trips idx, if precomputed
+  if (is_compiled(path_to_problem)) {
+    ProblemStream stream;
+    stream.open(path_to_problem, road_->hash, probset_);
+    Trip trip;
+    DistInt cost;
+    vec_t<Wayp> rte;
+    while (stream.next(trip, cost, rte)) {
+      trips.push_back(trip);
+      if (stream.has_costs()) costs.push_back(cost);
+    }
+  } else {
+    read_problem(path_to_problem, probset_);
+    for (const auto& kv : probset_.trips())
+      for (const Trip& trip : kv.second)
+        trips.push_back(trip);
+  }
+  if (trips.empty()) throw std::runtime_error("Problem file has no trips!");
+  TripId max_id = std::numeric_limits<TripId>::min();
+  base_ = std::numeric_limits<TripId>::max();
+  for (const Trip& trip : trips) {
+    base_ = std::min(trip.id(), base_);
+    max_id = std::max(trip.id(), max_id);
+  }
+  const size_t nids = max_id - base_ + 1;
+  trips_.assign(nids, Trip());
+  costs_.assign(nids, 0);
+  vehls_.assign(nids, {});
+  custs_.assign(nids, {});
+  for (size_t i = 0; i < trips.size(); ++i) {
+    const Trip& trip = trips.at(i);
+    const size_t k = trip.id() - base_;
+    trips_.at(k) = trip;
+    if (trip.load() < 0) total_vehicles_++;
+    if (trip.load() > 0) {
+      total_customers_++;
+      costs_.at(k) = (costs.empty()
+        ? road_->gtree.search(trip.orig(), trip.dest()) : costs.at(i));
+    }
+  }
+}
+
+size_t Replay::idx(const TripId& id) const {
+  const size_t k = (size_t)(id - base_);
+  if (k >= trips_.size() || trips_.at(k).id() != id)
+    throw std::runtime_error("trip "+std::to_string(id)+" is not in the instance");
+  return k;
+}
+
+void Replay::violation(const std::string& what) {
+  nviol_++;
+  if (verify_) std::cerr << "t=" << t_ << ": " << what << std::endl;
+}
+
+/* A new route starts at the vehicle's last-visited node */
+void Replay::route(const VehlId& vid, const vec_t<NodeId>& rte) {
+  VehlState& vehl = vehls_.at(idx(vid));
+  if (vehl.seen) {
+    if (vehl.rte.at(vehl.pos) != rte.front())
+      violation("vehicle "+std::to_string(vid)+" rerouted away from its position");
+    vehl.base += vehl.dist.at(vehl.pos);
+  }
+  const RoadGraph& g = road_->graph;
+  vehl.rte = rte;
+  vehl.dist.assign(1, 0);
+  for (size_t i = 1; i < rte.size(); ++i) {
+    DistInt w = 0;
+    try { w = g.weight(g.index(rte.at(i-1)), g.index(rte.at(i))); }
+    catch (const std::out_of_range &) {
+      violation("vehicle "+std::to_string(vid)+" routed over a missing edge ("
+                +std::to_string(rte.at(i-1))+", "+std::to_string(rte.at(i))+")");
+    }
+    vehl.dist.push_back(vehl.dist.back() + w);
+  }
+  vehl.pos = 0;
+  if (!vehl.seen) {  // initial route
+    const Trip& trip = trips_.at(idx(vid));
+    if (trip.dest() != -1) base_cost_ += vehl.cost();
+    vehl.seen = true;
+  }
+}
+
+void Replay::move(const VehlId& vid, const NodeId& node) {
+  VehlState& vehl = vehls_.at(idx(vid));
+  vehl.moved.push_back(node);
+  if (vehl.pos + 1 < vehl.rte.size() && vehl.rte.at(vehl.pos+1) == node) {
+    vehl.pos++;
+    return;
+  }
+  violation("vehicle "+std::to_string(vid)+" left its route at "+std::to_string(node));
+  for (size_t i = vehl.pos + 1; i < vehl.rte.size(); ++i)  // resynchronize
+    if (vehl.rte.at(i) == node) {
+      vehl.pos = i;
+      break;
+    }
+}
+
+/* Pickups and dropoffs are logged before the moves of their tick, and all
+ * pickups before all dropoffs, so the load is checked once the tick's stops
+ * are all made */
+void Replay::end_tick() {
+  vec_t<VehlId> full;
+  for (const auto& stop : stops_) {
+    const Trip& cust = trips_.at(idx(stop.first));
+    const VehlId& vid = custs_.at(idx(stop.first)).assigned;
+    const NodeId& loc = (stop.second ? cust.orig() : cust.dest());
+    if (vid == 0) continue;  // already reported
+    const VehlState& vehl = vehls_.at(idx(vid));
+    if (std::find(vehl.moved.begin(), vehl.moved.end(), loc) == vehl.moved.end())
+      violation("customer "+std::to_string(cust.id())+(stop.second ? " picked up" : " dropped off")
+                +" away from vehicle "+std::to_string(vid));
+    if (stop.second && vehl.onboard > -trips_.at(idx(vid)).load()
+     && std::find(full.begin(), full.end(), vid) == full.end()) {
+      violation("vehicle "+std::to_string(vid)+" over capacity");
+      full.push_back(vid);
+    }
+  }
+  stops_.clear();
+  for (VehlState& vehl : vehls_) vehl.moved.clear();
+}
+
+void Replay::run(const Filepath& path_to_dat, const Filepath& path_to_met,
+                 const SimlTime& metrics_interval) {
+  std::ifstream ifs(path_to_dat);
+  if (!ifs.good()) throw std::runtime_error("log not found");
+  std::ofstream f_met;
+  if (metrics_interval > 0) {
+    f_met.open(path_to_met, std::ios::out);
+    f_met << "t traveled penalty matches pickups dropoffs timeouts waiting"
+          << " avg_pickup_delay avg_trip_delay" << std::endl;
+  }
+
+  std::string line;
+  vec_t<int> ids;
+  size_t lineno = 0;
+  while (std::getline(ifs, line)) {
+    lineno++;
+    /* "t X id id ..." */
+    const char* p = line.c_str();
+    char* end;
+    const SimlTime t = std::strtol(p, &end, 10);
+    while (*end == ' ') end++;
+    const char type = *end;
+    if (end == p || type == '\0') {
+      std::cerr << path_to_dat << ":" << lineno << ": bad line" << std::endl;
+      continue;
+    }
+    ids.clear();
+    for (p = end + 1; ; p = end) {
+      const long x = std::strtol(p, &end, 10);
+      if (end == p) break;
+      ids.push_back(x);
+    }
+
+    if (t != t_) {
+      end_tick();
+      /* Cargo takes a snapshot at every interval-th tick, also at the ticks
+       * with no lines between t_ and t (where nothing changed) */
+      if (metrics_interval > 0) {
+        SimlTime b = (t_ < 0 ? 0 : (t_ + metrics_interval - 1) / metrics_interval * metrics_interval);
+        for (; b < t; b += metrics_interval)
+          put_metrics(f_met, b);
+      }
+      t_ = t;
+    }
+
+    switch (type) {
+      case 'R': {
+        if (ids.size() < 2) break;
+        route(ids.at(0), vec_t<NodeId>(ids.begin() + 1, ids.end()));
+        break;
+      }
+      case 'V': {
+        if (ids.size() < 2) break;
+        move(ids.at(0), ids.at(1));
+        break;
+      }
+      case 'M': {
+        const VehlId vid = ids.at(0);
+        for (size_t i = 1; i < ids.size(); ++i) {
+          const CustId cid = std::abs(ids.at(i));
+          CustState& cust = custs_.at(idx(cid));
+          if (ids.at(i) < 0) {
+            if (cust.assigned != vid)
+              violation("customer "+std::to_string(cid)+" removed from vehicle "
+                        +std::to_string(vid)+" it was not assigned to");
+            cust.assigned = 0;
+            matches_--;
+          } else {
+            if (cust.timedout || cust.pickup != -1)
+              violation("customer "+std::to_string(cid)+" assigned after pickup or timeout");
+            cust.assigned = vid;
+            matches_++;
+          }
+        }
+        break;
+      }
+      case 'P': {
+        for (const int& cid : ids) {
+          CustState& cust = custs_.at(idx(cid));
+          const Trip& trip = trips_.at(idx(cid));
+          cust.pickup = t;
+          sum_pickup_delay_ += (t - trip.early());
+          npickups_++;
+          if (cust.assigned == 0) {
+            violation("customer "+std::to_string(cid)+" picked up unassigned");
+            continue;
+          }
+          vehls_.at(idx(cust.assigned)).onboard += trip.load();
+          stops_.push_back({cid, true});
+        }
+        break;
+      }
+      case 'D': {
+        for (const int& cid : ids) {
+          CustState& cust = custs_.at(idx(cid));
+          const Trip& trip = trips_.at(idx(cid));
+          cust.dropoff = t;
+          int delay = (t - cust.pickup) - (costs_.at(idx(cid))/speed_);
+          if (delay == -1) delay = 0;  // as Cargo::step()
+          sum_trip_delay_ += delay;
+          ndropoffs_++;
+          if (cust.pickup == -1)
+            violation("customer "+std::to_string(cid)+" dropped off before pickup");
+          if (t > trip.late())
+            violation("customer "+std::to_string(cid)+" dropped off late");
+          if (cust.assigned == 0) {
+            violation("customer "+std::to_string(cid)+" dropped off unassigned");
+            continue;
+          }
+          vehls_.at(idx(cust.assigned)).onboard -= trip.load();
+          stops_.push_back({cid, false});
+        }
+        break;
+      }
+      case 'T': {
+        for (const int& cid : ids) {
+          CustState& cust = custs_.at(idx(cid));
+          if (cust.assigned != 0)
+            violation("customer "+std::to_string(cid)+" timed out while assigned");
+          cust.timedout = true;
+          penalty_ += costs_.at(idx(cid));
+          ntimeouts_++;
+        }
+        break;
+      }
+      case 'A': {
+        for (const int& vid : ids) {
+          VehlState& vehl = vehls_.at(idx(vid));
+          const Trip& trip = trips_.at(idx(vid));
+          if (trip.late() != -1 && t > trip.late())
+            violation("vehicle "+std::to_string(vid)+" arrived late");
+          if (vehl.onboard != 0)
+            violation("vehicle "+std::to_string(vid)+" arrived with customers on board");
+          vehl.arrived = true;
+          traveled_ += vehl.cost();
+        }
+        break;
+      }
+      case 'Q': {
+        if (!ids.empty()) waiting_ = ids.at(0);
+        break;
+      }
+      case 'L':  // follows from P and D
+        break;
+      default:
+        std::cerr << path_to_dat << ":" << lineno << ": unknown message " << type << std::endl;
+    }
+  }
+  end_tick();
+
+  /* As Cargo::total_solution_cost(): taxis stopped without an arrival
+   * message, and customers that appeared but were never served */
+  for (size_t k = 0; k < trips_.size(); ++k) {
+    const Trip& trip = trips_.at(k);
+    if (trip.load() < 0 && vehls_.at(k).seen && !vehls_.at(k).arrived)
+      traveled_ += vehls_.at(k).cost();
+    if (trip.load() > 0 && trip.early() <= t_) {
+      const CustState& cust = custs_.at(k);
+      base_cost_ += costs_.at(k);
+      if (cust.assigned == 0 && !cust.timedout && cust.dropoff == -1)
+        penalty_ += costs_.at(k);
+    }
+  }
+  t_++;  // Cargo ends past its last step
+  if (metrics_interval > 0) put_metrics(f_met, t_);  // final
+}
+
+void Replay::put_metrics(std::ostream& os, const SimlTime& t) {
+  os << t
+     << ' ' << traveled_
+     << ' ' << penalty_
+     << ' ' << matches_
+     << ' ' << npickups_
+     << ' ' << ndropoffs_
+     << ' ' << ntimeouts_
+     << ' ' << waiting_
+     << ' ' << (npickups_ == 0 ? -1 : sum_pickup_delay_/(long int)npickups_)
+     << ' ' << (ndropoffs_ == 0 ? -1 : sum_trip_delay_/(long int)ndropoffs_)
+     << std::endl;
+}
+
+void Replay::put_solution(std::ostream& os) {
+  os << probset_.name()         << '\n'
+     << probset_.road_network() << '\n'
+     << "Tot. number of vehicles     " << total_vehicles_         << '\n'
+     << "Tot. number of customers    " << total_customers_        << '\n'
+     << "Base distance      (meters) " << base_cost_              << '\n'
+     << "Solution distance  (meters) " << traveled_+penalty_      << '\n'
+     << "  Total traveled   (meters) " << traveled_               << '\n'
+     << "  Penalty          (meters) " << penalty_                << '\n'
+     << "Solution matches            " << matches_                << '\n'
+     << "Avg. pickup delay     (sec) " << (npickups_ == 0 ? -1 : sum_pickup_delay_/(long int)npickups_) << '\n'
+     << "Avg. trip delay       (sec) " << (ndropoffs_ == 0 ? -1 : sum_trip_delay_/(long int)ndropoffs_) << '\n'
+     << "Replayed ticks              " << t_                      << '\n'
+     << "Violations                  " << nviol_
+     << std::endl;
+}
+
+int main(int argc, char** argv) {
+  bool verify = false;
+  SimlTime metrics_interval = 0;
+  vec_t<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "-v")
+      verify = true;
+    else if (arg == "-m" && i + 1 < argc)
+      metrics_interval = std::atoi(argv[++i]);
+    else
+      args.push_back(arg);
+  }
+  if (args.size() != 3) {
+    std::cout << "Usage: ./replay [-v] [-m interval] <rnet> <instance> <dat>" << std::endl;
+    return 1;
+  }
+  const Filepath& dat = args.at(2);
+  const Filepath stem = dat.substr(0, dat.rfind(".dat"));
+
+  Replay replay(args.at(0), args.at(1), verify);
+  replay.run(dat, stem+".replay.met", metrics_interval);
+  std::ofstream f_sol(stem+".replay.sol", std::ios::out);
+  replay.put_solution(f_sol);
+  replay.put_solution(std::cout);
+  return (verify && replay.violations() > 0) ? 2 : 0;
+}
@@ -0,0 +1,19 @@
+tiny-m5n30-s10-x1
+tiny
+Tot. number of vehicles     5
+Tot. number of customers    30
+Base distance      (meters) 37677
+Solution distance  (meters) 40785
+  Total traveled   (meters) 21204
+  Penalty          (meters) 19581
+Solution matches            14
+Rejected                    0
+Avg. pickup delay     (sec) 145
+Avg. trip delay       (sec) 24
+Avg. handle_customer   (ms) 0
+Avg. handle_vehicle    (ms) 0
+Avg. match             (ms) 0
+Avg. listen            (ms) 1.30769
+Avg. number cust. per batch 9.46154
+Avg. number vehl. per batch 5
+Count shortest-path comps   57063